@@ -0,0 +1,150 @@
+// include/CC1101Sim.h
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "CC1101Transport.h"
+
+// Software CC1101 plus the heaters it can hear, behind the transport API.
+//
+// Models what DieselHeaterRF relies on: the configuration registers, PATABLE,
+// command strobes, MARCSTATE and the chip status byte, the 64-byte RX/TX
+// FIFOs (including RX overflow), MCSM1 RXOFF/TXOFF modes, and GDO2 as
+// configured by IOCFG2 = 0x07 (high while a received packet waits at the head
+// of the RX FIFO, cleared by the first FIFO read). Wake-on-Radio (SWOR) is
+// modelled by its duty cycle: a packet is caught only if an RX window, set by
+// WOREVT/WORCTRL and MCSM2 RX_TIME, is open when it starts or opens before
+// its sync word ends. Heaters may sit off the nominal frequency: what FSCTRL0
+// leaves of the offset is reported in FREQEST, and packets (both ways) get
+// lost increasingly beyond the FOCCFG compensation range of BW/4 and always
+// beyond half the channel bandwidth.
+//
+// A background "air" thread broadcasts status packets from every simulated
+// heater at the configured rate. They land in the RX FIFO only while the chip
+// is in RX, as on real hardware. Commands sent with STX are decoded and
+// applied, so power, mode, setpoint and pump frequency behave like a heater.
+// The GDO2 wait sleeps in poll() on an eventfd, so cancellation works as it
+// does with the GPIO edge fd.
+class CC1101Sim : public CC1101Transport
+{
+
+public:
+
+    struct Config {
+        std::vector<uint32_t> heaters;       // Heater addresses on air
+        double   rateHz       = 1.0;         // Status packets per second per heater
+        double   corruptRate  = 0.0;         // Fraction of packets with a flipped bit
+        double   dropRate     = 0.0;         // Fraction of packets lost on air
+        int      rssiDbm      = -60;
+        int      rssiJitterDb = 3;
+        uint32_t spiLatencyUs = 0;           // Added to every SPI transaction
+        uint32_t spiMaxHz     = 0;           // Above this SPI clock reads see bit errors (0: none)
+        uint32_t seed         = 1;
+        double   freqOffsetKhz      = 0.0;   // Heater carrier offset from nominal
+        double   freqDriftKhzPerMin = 0.0;   // ... changing by this much per minute
+
+        // SIM_HEATERS, SIM_RATE_HZ, SIM_CORRUPT, SIM_DROP, SIM_RSSI_DBM,
+        // SIM_SPI_LATENCY_US, SIM_SPI_MAX_HZ, SIM_SEED, SIM_FREQ_OFFSET_KHZ,
+        // SIM_FREQ_DRIFT_KHZ_PER_MIN.
+        static Config fromEnv();
+    };
+
+    explicit CC1101Sim(const Config &config);
+    ~CC1101Sim() override;
+
+    void begin() override;
+    void transfer(const uint8_t *tx, uint8_t *rx, size_t len) override;
+    bool waitForGdo2(uint32_t timeoutMs, int cancelFd) override;
+    bool setSpeed(uint32_t hz) override;
+    uint32_t speed() const override;
+    const char *name() const override { return "simulator"; }
+
+    uint64_t packetsSent() const { return _sent.load(std::memory_order_relaxed); }
+    uint64_t packetsMissed() const { return _missed.load(std::memory_order_relaxed); }
+    uint64_t packetsCorrupted() const { return _corrupted.load(std::memory_order_relaxed); }
+    uint64_t commandsApplied() const { return _commands.load(std::memory_order_relaxed); }
+
+private:
+
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr size_t kFifoSize = 64;
+    static constexpr size_t kFrameLen = 24; // Status packet incl. appended RSSI/LQI
+
+    struct Heater {
+        uint32_t addr     = 0;
+        uint8_t  state    = 0;
+        bool     autoMode = true;
+        int8_t   setpoint = 20;
+        float    pumpFreq = 2.0f;
+        float    ambient  = 18.0f;
+        float    caseTemp = 18.0f;
+        int      lastSeq  = -1;
+        Clock::time_point phaseEnd;
+        Clock::time_point lastUpdate;
+        Clock::time_point nextTx;
+    };
+
+    Config _config;
+
+    mutable std::mutex      _mutex;
+    std::condition_variable _cv;
+    std::thread             _air;
+    bool                    _stop = false;
+    int                     _gdoFd = -1;
+    std::mt19937            _rng;
+    uint32_t                _speedHz = 250000; // HEATER_SPI_SPEED_HZ until setSpeed()
+
+    uint8_t _regs[0x2F];
+    uint8_t _paTable[8];
+    uint8_t _marc = 0x01;
+    uint8_t _rxFifo[kFifoSize];
+    size_t  _rxLen     = 0;
+    size_t  _rxPartial = 0; // Bytes already read from the packet at the FIFO head
+    uint8_t _txFifo[kFifoSize];
+    size_t  _txLen     = 0;
+    bool    _gdo2      = false;
+    bool    _wor       = false;
+    Clock::time_point _worStart;
+    uint8_t _lastRssi  = 0;
+    uint8_t _lastLqi   = 0;
+    uint8_t _lastFreqEst = 0;
+    Clock::time_point _start;
+    Clock::time_point _txEnd;
+
+    std::vector<Heater> _heaters;
+
+    std::atomic<uint64_t> _sent{0};
+    std::atomic<uint64_t> _missed{0};
+    std::atomic<uint64_t> _corrupted{0};
+    std::atomic<uint64_t> _commands{0};
+
+    // All of the below require _mutex.
+    void     reset();
+    void     settle(Clock::time_point now);
+    uint8_t  statusByte(bool read) const;
+    uint8_t  readStatus(uint8_t addr);
+    uint8_t  popRx();
+    void     strobe(uint8_t cmd, Clock::time_point now);
+    void     transmit(Clock::time_point now);
+    void     applyCommand(Heater &h, uint8_t cmd, Clock::time_point now);
+    void     step(Heater &h, Clock::time_point now);
+    void     broadcast(Heater &h, Clock::time_point now);
+    void     raiseGdo2();
+    uint8_t  offMode(int shift) const;
+    bool     worCatches(Clock::time_point start) const;
+    double   baud() const;
+    double   channelBwKhz() const;
+    bool     tunedCatches(Clock::time_point now, uint8_t *freqEst);
+    Clock::duration airtime(size_t bytes) const;
+    Clock::duration period();
+
+    void airLoop();
+};
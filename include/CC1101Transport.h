@@ -0,0 +1,45 @@
+// include/CC1101Transport.h
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "pi_spi.h"
+
+// Everything DieselHeaterRF needs from the hardware: CS-framed SPI
+// transactions with the CC1101 and the GDO2 line.
+//
+// PiTransport drives a real chip through spidev and GPIO; CC1101Sim is an
+// in-process software model, so the bridge runs on any Linux box.
+class CC1101Transport
+{
+
+public:
+
+    virtual ~CC1101Transport() = default;
+
+    // Configure pins / open devices. May be called more than once.
+    virtual void begin() = 0;
+
+    // One CC1101 transaction: assert CS, wait for CHIP_RDYn, clock len
+    // bytes, deassert CS. rx[0] receives the chip status byte.
+    virtual void transfer(const uint8_t *tx, uint8_t *rx, size_t len) = 0;
+
+    // Every queued operation, each framed by its own CS pulse.
+    virtual void transferBatch(PiSPIBatch &batch) {
+        for (size_t i = 0; i < batch.size(); i++)
+            transfer(batch.tx(i), batch.rx(i), batch.len(i));
+    }
+
+    // Block until GDO2 is high, timeoutMs elapses or cancelFd becomes
+    // readable. Returns true only if GDO2 is high.
+    virtual bool waitForGdo2(uint32_t timeoutMs, int cancelFd) = 0;
+
+    // Change the SPI clock. Returns false if the transport has no clock to
+    // set; speed() is then 0.
+    virtual bool setSpeed(uint32_t hz) { (void)hz; return false; }
+    virtual uint32_t speed() const { return 0; }
+
+    // For logging.
+    virtual const char *name() const = 0;
+};
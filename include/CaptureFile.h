@@ -0,0 +1,99 @@
+// include/CaptureFile.h
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+// Append-only binary capture of the status packets the radio received.
+//
+// Layout (little-endian, as on the Pi and x86):
+//
+//   header  16 bytes  "DHCAP\0" magic, u16 version (2), u16 record size (32),
+//                     6 reserved bytes
+//   record  32 bytes  u64 receive time (us since the epoch), then the 24 bytes
+//                     drained from the RX FIFO: the 21-byte packet including
+//                     its CRC-16, a pad byte, and the chip-appended RSSI and
+//                     LQI | CRC_OK status bytes
+//
+// Frames are recorded before the CRC check, so corrupted packets are kept and
+// the replay sees exactly what the decoder saw. Records are fixed size, so a
+// file cut short by a crash loses at most its last partial record.
+//
+// Version 2 adds drain records: the top bit of the time is set and the rest
+// is the receive time of the newest frame the publisher took in one batch,
+// so the replay can batch frames exactly as the bridge did. Their data is
+// zero. Version 1 files have no drain records and can still be read.
+struct CaptureRecord {
+    uint64_t timestampUs;
+    char     data[24];
+
+    static constexpr uint64_t kDrain = 1ull << 63;
+
+    bool     isDrain() const { return (timestampUs & kDrain) != 0; }
+    uint64_t drainedThroughUs() const { return timestampUs & ~kDrain; }
+};
+static_assert(sizeof(CaptureRecord) == 32, "capture record layout");
+
+// Appends records with one write() each; safe to call from any thread.
+class CaptureWriter
+{
+
+public:
+
+    CaptureWriter() = default;
+    ~CaptureWriter();
+
+    // Open path for appending, creating it with a header if it is new or
+    // empty. Returns false (with error set) if the file cannot be opened or
+    // is not a version 2 capture file.
+    bool open(const std::string &path, std::string *error = nullptr);
+    void close();
+    bool isOpen() const { return _fd >= 0; }
+
+    void append(uint64_t timestampUs, const char *data);
+
+    // Mark that the publisher has taken every frame received up to and
+    // including throughUs.
+    void appendDrain(uint64_t throughUs);
+
+    uint64_t records() const { return _records.load(std::memory_order_relaxed); }
+
+private:
+
+    int                   _fd = -1;
+    std::mutex            _mutex;
+    std::atomic<uint64_t> _records{0};
+};
+
+// Read-only, memory-mapped view of a capture file.
+class CaptureReader
+{
+
+public:
+
+    CaptureReader() = default;
+    ~CaptureReader();
+
+    CaptureReader(const CaptureReader &) = delete;
+    CaptureReader &operator=(const CaptureReader &) = delete;
+
+    bool open(const std::string &path, std::string *error = nullptr);
+    void close();
+
+    uint16_t version() const { return _version; }
+    size_t size() const { return _count; }
+    const CaptureRecord &operator[](size_t i) const { return _records[i]; }
+    const CaptureRecord *begin() const { return _records; }
+    const CaptureRecord *end() const { return _records + _count; }
+
+private:
+
+    void                *_map   = nullptr;
+    size_t               _len   = 0;
+    const CaptureRecord *_records = nullptr;
+    size_t               _count = 0;
+    uint16_t             _version = 0;
+};
@@ -0,0 +1,97 @@
+// include/DeltaPublisher.h
+#pragma once
+
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// Change-only publishing policy for one heater's telemetry topics.
+//
+// Remembers the last *published* value of each field and reports a field as
+// changed only when it moves by more than that field's deadband (0 = any
+// change), so slow jitter cannot creep through. Every keepalive interval a
+// cycle is a full refresh and everything is re-sent. Fields are small integer
+// ids chosen by the caller; nothing here allocates.
+class DeltaPublisher
+{
+
+public:
+
+    static constexpr size_t kMaxFields = 16;
+
+    DeltaPublisher() {
+        for (size_t i = 0; i < kMaxFields; i++) {
+            _deadband[i] = 0;
+            _last[i]     = 0;
+            _seen[i]     = false;
+            _force[i].store(false, std::memory_order_relaxed);
+        }
+    }
+
+    void setDeadband(size_t field, double deadband) {
+        if (field < kMaxFields) _deadband[field] = deadband;
+    }
+
+    // 0 disables change-only publishing: every cycle is a full refresh.
+    void setKeepalive(uint32_t ms) { _keepaliveMs = ms; }
+
+    // Start a publish cycle. Returns true if this cycle re-sends everything.
+    bool beginCycle(uint32_t nowMs) {
+        _any  = false;
+        _full = _keepaliveMs == 0 || !_started || nowMs - _lastFullMs >= _keepaliveMs;
+        if (_full) {
+            _lastFullMs = nowMs;
+            _started    = true;
+        }
+        return _full;
+    }
+
+    // True if value should be published this cycle; records it if so.
+    bool changed(size_t field, double value) {
+        if (field >= kMaxFields) return true;
+        bool forced = _force[field].exchange(false, std::memory_order_relaxed);
+        if (!_full && !forced && _seen[field] && std::fabs(value - _last[field]) <= _deadband[field]) {
+            _suppressed++;
+            return false;
+        }
+        _last[field] = value;
+        _seen[field] = true;
+        _any         = true;
+        _published++;
+        return true;
+    }
+
+    // Force field out on the next cycle, e.g. after another code path
+    // published an optimistic value to the same topic. Thread-safe.
+    void invalidate(size_t field) {
+        if (field < kMaxFields) _force[field].store(true, std::memory_order_relaxed);
+    }
+
+    // Force every field out on the next cycle, e.g. when the values now come
+    // from another heater. Thread-safe.
+    void invalidate() {
+        for (size_t i = 0; i < kMaxFields; i++) invalidate(i);
+    }
+
+    // Whether any field was published in the current cycle.
+    bool anyChanged() const { return _any; }
+
+    uint64_t published() const { return _published; }
+    uint64_t suppressed() const { return _suppressed; }
+
+private:
+
+    double            _deadband[kMaxFields];
+    double            _last[kMaxFields];
+    bool              _seen[kMaxFields];
+    std::atomic<bool> _force[kMaxFields];
+
+    uint32_t _keepaliveMs = 300000;
+    uint32_t _lastFullMs  = 0;
+    bool     _started     = false;
+    bool     _full        = true;
+    bool     _any         = false;
+    uint64_t _published   = 0;
+    uint64_t _suppressed  = 0;
+};
@@ -2,16 +2,27 @@
 #pragma once
 
 #include <cstdint>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include "CC1101Transport.h"
 #include "pi_arduino_compat.h"
 #include "pi_gpio.h"
 #include "pi_spi.h"
 
+class CaptureWriter;
+
 #define HEATER_SCK_PIN   11   // GPIO11 (header pin 23)
 #define HEATER_MISO_PIN  9    // GPIO9  (header pin 21)
 #define HEATER_MOSI_PIN  10   // GPIO10 (header pin 19)
 #define HEATER_SS_PIN    8    // GPIO8  (header pin 24, CSn)
 #define HEATER_GDO2_PIN  25   // GPIO25 (header pin 22)
 
+#define HEATER_SPI_DEVICE   "/dev/spidev0.0"
+#define HEATER_SPI_SPEED_HZ 250000
+
 #define HEATER_CMD_WAKEUP 0x23
 #define HEATER_CMD_MODE   0x24
 #define HEATER_CMD_POWER  0x2b
@@ -28,6 +39,13 @@
 #define HEATER_STATE_SHUTTING_DOWN  0x07
 #define HEATER_STATE_COOLING        0x08
 
+// UP/DOWN step the setpoint (auto mode, 1 degC) or the pump frequency
+// (manual mode, 0.1 Hz) within these limits.
+#define HEATER_SETPOINT_MIN     8
+#define HEATER_SETPOINT_MAX     36
+#define HEATER_PUMP_FREQ_MIN    1.0f
+#define HEATER_PUMP_FREQ_MAX    5.5f
+
 #define HEATER_TX_REPEAT    10
 #define HEATER_RX_TIMEOUT   5000
 
@@ -43,6 +61,26 @@ typedef struct {
   int16_t rssi        = 0;
 } heater_state_t;
 
+// One raw status packet as drained from the RX FIFO (including the appended
+// RSSI and LQI/CRC_OK status bytes).
+typedef struct {
+  uint64_t timestampUs = 0;   // Wall clock, microseconds since the epoch
+  char     data[24]    = {};
+  int16_t  rssi        = 0;   // dBm
+  uint8_t  lqi         = 0;
+} heater_frame_t;
+
+// Outcome of DieselHeaterRF::sendCommandAcked().
+typedef struct {
+  bool           delivered = false; // A status packet showed the expected change
+  uint8_t        bursts    = 0;     // Bursts transmitted
+  uint8_t        frames    = 0;     // Command packets transmitted
+  uint32_t       elapsedMs = 0;
+  bool           heard     = false; // Any status packet heard from the heater
+  bool           txFailed  = false; // A packet never left TX; the send was aborted
+  heater_state_t state;             // Last status heard (valid if heard)
+} heater_ack_t;
+
 class DieselHeaterRF
 {
 
@@ -64,10 +102,23 @@ public:
         _pinGdo2 = gdo2;
     }
 
+    // Talk to the chip through transport (e.g. CC1101Sim) instead of the
+    // Pi's spidev and GPIO. transport must outlive this object.
+    explicit DieselHeaterRF(CC1101Transport &transport) : DieselHeaterRF() {
+        _transport = &transport;
+    }
+
     ~DieselHeaterRF() = default;
 
+    // Configure the radio. Unless setColdStart(true), a chip still carrying
+    // this configuration from a previous run (only a power cycle clears it)
+    // is not reset: its registers are read back and only those that differ
+    // are rewritten.
     void begin();
     void begin(uint32_t heaterAddr);
+    void setColdStart(bool cold) { _coldStart = cold; }
+    // Registers the last begin() rewrote on a warm start, -1 after a reset.
+    int  startRewrites() const { return _startRewrites; }
 
     void setAddress(uint32_t heaterAddr);
     bool getState(heater_state_t *state);
@@ -80,8 +131,73 @@ public:
     void sendCommand(uint8_t cmd);
     void sendCommand(uint8_t cmd, uint32_t addr);
     void sendCommand(uint8_t cmd, uint32_t addr, uint8_t numTransmits);
+
+    // Closed-loop send: transmit cmd in bursts of burstLen packets and,
+    // after each burst, listen up to listenMs for a status packet from addr
+    // for which acked() is true. Stops at the first such packet or after
+    // maxFrames packets. Returns result->delivered.
+    bool sendCommandAcked(uint8_t cmd, uint32_t addr,
+                          const std::function<bool(const heater_state_t &)> &acked,
+                          heater_ack_t *result,
+                          uint8_t burstLen = 2, uint8_t maxFrames = HEATER_TX_REPEAT,
+                          uint16_t listenMs = 500);
+
+    // Pipelined UP/DOWN: send count copies of cmd back to back, each under
+    // its own sequence number (so the heater applies every one) and repeated
+    // burstLen times, then listen up to listenMs for a status packet from
+    // addr for which reached() is true. Returns result->delivered; on a miss
+    // result->state holds the last status heard, to resume from.
+    bool sendSteps(uint8_t cmd, uint8_t count, uint32_t addr,
+                   const std::function<bool(const heater_state_t &)> &reached,
+                   heater_ack_t *result, uint8_t burstLen = 2, uint16_t listenMs = 500);
     uint32_t findAddress(uint16_t timeout);
 
+    // Continuous receive: the radio returns to RX after every packet instead
+    // of idling, and receiveFrame() hands back each CRC-valid frame.
+    void startStreaming();
+    void stopStreaming();
+    bool isStreaming() const { return _streaming; }
+    bool receiveFrame(heater_frame_t *frame, uint32_t timeout);
+
+    // Listen with Wake-on-Radio instead of continuous RX: the chip sleeps
+    // and its event timer wakes it every periodMs to sniff for a packet for
+    // the MCSM2 RX_TIME fraction of the period (0 = 3.6 %, each step halves
+    // it, 7 = until end of packet). GDO2 still signals each packet. Cuts
+    // radio current at the cost of missing broadcasts that start while the
+    // chip sleeps. Applies from the next startStreaming().
+    void setWakeOnRadio(bool enable, uint16_t periodMs = 25, uint8_t rxTime = 0);
+    bool wakeOnRadio() const { return _worEnabled; }
+
+    // Frequency offset tracking. After every good packet the offset the
+    // demodulator measured (FREQEST) is added to the FSCTRL0 correction in
+    // use and averaged into that heater's learned offset. FSCTRL0 follows
+    // the learned offset of the heater being talked to (or the mean of all
+    // heaters in the multi-heater mode) once it is thresholdSteps away.
+    // Offsets are in FSCTRL0 steps of fXOSC / 2^14, about 1.59 kHz.
+    void setFreqTracking(bool enable, uint8_t thresholdSteps = 2);
+    bool freqTracking() const { return _freqTracking; }
+    // Learned offset of addr; false if none yet. Safe from any thread.
+    bool freqOffset(uint32_t addr, float *steps) const;
+    // Seed the learned offset of addr, e.g. from a previous run. Applied at
+    // the next receive or transmit.
+    void setFreqOffset(uint32_t addr, float steps);
+    // FSCTRL0 correction currently applied. Safe from any thread.
+    int8_t appliedFreqOffset() const { return _appliedFreqOffset.load(std::memory_order_relaxed); }
+
+    static void     decodeState(const char *buf, heater_state_t *state);
+    static uint32_t parseAddress(const char *buf);
+
+    // While cancelFd is readable, receive waits return early (no packet).
+    void setCancelFd(int cancelFd) { _cancelFd = cancelFd; }
+    // Once *stop is true, acknowledged sends and step sequences give up
+    // instead of starting another burst. A cancelFd signal alone only ends
+    // the current receive wait.
+    void setStopFlag(const std::atomic<bool> *stop) { _stop = stop; }
+
+    // Record every packet drained from the RX FIFO, before the CRC check
+    // (nullptr stops recording). capture must outlive its use here.
+    void setCapture(CaptureWriter *capture) { _capture = capture; }
+
 private:
 
     uint8_t  _pinSck;
@@ -90,10 +206,43 @@ private:
     uint8_t  _pinSs;
     uint8_t  _pinGdo2;
 
+    CC1101Transport *_transport = nullptr;
+    std::unique_ptr<CC1101Transport> _ownedTransport; // Default PiTransport
+
     uint32_t _heaterAddr = 0;
     uint8_t  _packetSeq  = 0;
+    int      _cancelFd   = -1;
+    const std::atomic<bool> *_stop = nullptr;
+    CaptureWriter *_capture = nullptr;
+    bool     _streaming  = false;
+    bool     _worEnabled = false;
+    bool     _worActive  = false;
+    uint16_t _worPeriodMs = 25;
+    uint8_t  _worRxTime   = 0;
+
+    // Shadow of configuration registers 0x00-0x2E as last written, so that
+    // register reads need no SPI transaction and rewriting an unchanged
+    // value is skipped. Registers the chip's calibration writes are not
+    // shadowed.
+    uint8_t  _shadow[0x2F] = {};
+    bool     _shadowValid   = false;
+    bool     _coldStart     = false;
+    int      _startRewrites = -1;
+
+    bool     _freqTracking  = false;
+    uint8_t  _freqThreshold = 2;
+    mutable std::mutex        _freqMutex;
+    std::map<uint32_t, float> _freqOffsets; // Learned offset per heater address
+    std::atomic<int8_t>       _appliedFreqOffset{0};
 
     void initRadio();
+    bool warmStart();
+
+    void buildCommand(uint8_t cmd, uint32_t addr, char *buf);
+    bool transmitPacket(char *buf);
+    bool stopping() const { return _stop && _stop->load(std::memory_order_relaxed); }
+    static void countAckOutcome(const heater_ack_t &result);
+    bool listenForState(uint32_t addr, heater_state_t *state, uint32_t timeout);
 
     void txBurst(uint8_t len, char *bytes);
     void txFlush();
@@ -102,8 +251,18 @@ private:
     void rxFlush();
     void rxEnable();
 
+    void startWor();
+    void rearmWor();
+
+    int8_t readFreqEst();
+    void   trackFrequency(uint32_t addr, int8_t freqEst);
+    bool   applyFreqOffset(uint32_t addr);
+
+    // Poll MARCSTATE until it reads state, sleeping pollUs between reads.
+    // Gives up after timeoutUs and returns false.
+    bool waitMarcState(uint8_t state, uint32_t timeoutUs, uint32_t pollUs = 0);
+
     bool     receivePacket(char *bytes, uint16_t timeout);
-    uint32_t parseAddress(char *buf);
     uint16_t crc16_2(char *buf, int len);
 
     // CC1101 SPI primitives — each is a single, atomic SPI transaction.
@@ -112,7 +271,14 @@ private:
     uint8_t readStatusReg(uint8_t addr);
     void    strobe(uint8_t cmd);
     void    writeBurstReg(uint8_t addr, const uint8_t *data, uint8_t len);
+    void    readBurstReg(uint8_t addr, uint8_t *data, uint8_t len);
+
+    // Queue operations into a batch, then run it as one CS-framed transfer.
+    void queueStrobe(PiSPIBatch &batch, uint8_t cmd);
+    void queueWriteBurst(PiSPIBatch &batch, uint8_t addr, const uint8_t *data, uint8_t len);
+    void queueOp(PiSPIBatch &batch, const uint8_t *tx, size_t len);
+    void spiBatch(PiSPIBatch &batch);
 
-    // Core: assert CS, wait for CHIP_RDYn (MISO low), transfer, deassert CS.
+    // Core: one CS-framed transaction through the transport.
     void spiTransaction(const uint8_t *tx, uint8_t *rx, size_t len);
 };
@@ -0,0 +1,78 @@
+// include/EventLoop.h
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Single-threaded epoll reactor.
+//
+// File descriptors, timers (timerfd) and signals (signalfd) are dispatched
+// on the thread calling run(), as soon as epoll reports them; nothing sleeps
+// on a fixed period. Other threads hand work to the loop with post(), which
+// wakes it through an eventfd.
+class EventLoop
+{
+
+public:
+
+    using Handler = std::function<void(uint32_t events)>;
+
+    // Throws std::runtime_error if epoll or the wakeup eventfd cannot be
+    // created.
+    EventLoop();
+    ~EventLoop();
+
+    EventLoop(const EventLoop &) = delete;
+    EventLoop &operator=(const EventLoop &) = delete;
+
+    // Watch fd for events (EPOLLIN, EPOLLOUT, ...). The loop does not own fd.
+    bool add(int fd, uint32_t events, Handler handler);
+    bool modify(int fd, uint32_t events);
+    void remove(int fd);
+
+    // Timer firing after firstMs, then every intervalMs (0 = once). Returns
+    // an id for setTimer/removeTimer, or -1.
+    int  addTimer(uint32_t firstMs, uint32_t intervalMs, std::function<void()> fn);
+    // Re-arm a timer; firstMs 0 disarms it.
+    void setTimer(int timer, uint32_t firstMs, uint32_t intervalMs = 0);
+    void removeTimer(int timer);
+
+    // Block sigs in the calling thread. Call before starting any other
+    // thread, so they all inherit the mask and the signals only ever arrive
+    // through addSignals.
+    static void blockSignals(std::initializer_list<int> sigs);
+    bool addSignals(std::initializer_list<int> sigs, std::function<void(int)> fn);
+
+    // Run fn on the loop thread. Safe from any thread.
+    void post(std::function<void()> fn);
+    // Interrupt epoll_wait so the next iteration's hooks run.
+    void wake();
+
+    // Run before every epoll_wait, e.g. to refresh write interest.
+    void setIdleHook(std::function<void()> fn) { _idle = std::move(fn); }
+
+    // Dispatch until stop() (callable from any thread or handler).
+    void run();
+    void stop();
+
+private:
+
+    int _epollFd = -1;
+    int _wakeFd  = -1;
+    bool _stop   = false;
+
+    std::unordered_map<int, std::shared_ptr<Handler>> _handlers;
+    std::vector<int> _owned; // timerfds and signalfds closed with the loop
+
+    std::mutex                         _postMutex;
+    std::vector<std::function<void()>> _posted;
+    std::function<void()>              _idle;
+
+    void runPosted();
+    void closeOwned(int fd);
+};
@@ -0,0 +1,104 @@
+// include/HistoryStore.h
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+#include "DieselHeaterRF.h"
+
+// Persistent telemetry history for one heater, in a fixed-size memory-mapped
+// file (e.g. /data/history.bin).
+//
+// Three rings share the file: raw samples (12 bytes each, at most one per
+// sample interval), and 1-minute and 1-hour min/max/avg rollups. The rollups
+// are updated incrementally as samples arrive; the bucket still filling sits
+// in the file header, so a restart resumes it. Range queries read the rollup
+// rings with a binary search on time and never scan raw samples unless asked
+// for them. The kernel writes dirty pages back; flush() forces it.
+//
+// Samples are kept in time order: one older than the newest stored (the
+// clock stepped back) is ignored.
+
+// Packed raw sample; field units match the wire format.
+struct HistorySample {
+    uint32_t time;        // Unix seconds
+    int8_t   ambientTemp; // degC
+    uint8_t  caseTemp;    // degC
+    uint8_t  voltage;     // 0.1 V
+    uint8_t  pumpFreq;    // 0.1 Hz
+    int8_t   rssi;        // dBm, clamped to -128
+    int8_t   setpoint;
+    uint8_t  state;
+    uint8_t  flags;       // Bit 0: auto mode, bit 1: running
+};
+static_assert(sizeof(HistorySample) == 12, "history sample layout");
+
+// Metrics aggregated in rollups, in HistorySample units.
+enum HistoryMetric : size_t {
+    H_AMBIENT_TEMP, H_CASE_TEMP, H_VOLTAGE, H_PUMP_FREQ, H_RSSI, H_METRIC_COUNT
+};
+
+struct HistoryStat {
+    int16_t min;
+    int16_t max;
+    int32_t sum;
+};
+
+struct HistoryBucket {
+    uint32_t    start;   // Unix seconds, aligned to the bucket width
+    uint32_t    count;   // Samples aggregated
+    uint32_t    onCount; // Samples with the heater running
+    uint32_t    reserved;
+    HistoryStat stat[H_METRIC_COUNT];
+};
+
+class HistoryStore
+{
+
+public:
+
+    static constexpr uint32_t kRawCapacity    = 7 * 24 * 720;  // 7 days at 5 s
+    static constexpr uint32_t kMinuteCapacity = 14 * 24 * 60;  // 14 days
+    static constexpr uint32_t kHourCapacity   = 2 * 366 * 24;  // 2 years
+
+    HistoryStore() = default;
+    ~HistoryStore();
+
+    HistoryStore(const HistoryStore &) = delete;
+    HistoryStore &operator=(const HistoryStore &) = delete;
+
+    // Map path, creating or resetting it if it is missing or its layout does
+    // not match. Returns false (with error set) if it cannot be mapped.
+    bool open(const std::string &path, std::string *error = nullptr);
+    void close();
+    bool isOpen() const { return _map != nullptr; }
+
+    // Raw samples closer together than this are only counted in rollups.
+    void setSampleInterval(uint32_t seconds) { _sampleInterval = seconds; }
+
+    void record(uint32_t time, const heater_state_t &st, bool on);
+
+    // JSON for [from, to] at step 1 (raw), 60 or 3600 s: per-step points plus
+    // a summary over the whole range, at most maxPoints points (the newest
+    // are kept). step 0 picks minutes for up to a day, else hours.
+    std::string query(uint32_t from, uint32_t to, uint32_t step, size_t maxPoints = 1440);
+
+    void flush();
+
+private:
+
+    struct Header;
+
+    std::mutex     _mutex;
+    void          *_map = nullptr;
+    size_t         _len = 0;
+    Header        *_hdr = nullptr;
+    HistorySample *_raw = nullptr;
+    HistoryBucket *_minutes = nullptr;
+    HistoryBucket *_hours = nullptr;
+    uint32_t       _sampleInterval = 5;
+
+    void reset();
+};
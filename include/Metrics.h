@@ -0,0 +1,147 @@
+// include/Metrics.h
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+
+// Process-wide metrics: counters, gauges and fixed-bucket latency
+// histograms.
+//
+// Updates are relaxed atomic operations, so the radio hot paths can record
+// freely. Metrics are registered once by name, and the registry hands back a
+// reference that stays valid for the life of the process. Hot paths keep that
+// reference in a function-local static, e.g.
+//
+//   static Counter &crcErrors = metrics().counter("cc1101_rx_crc_errors_total", "...");
+//
+// Histograms record microseconds and are exported in seconds.
+
+class Counter
+{
+
+public:
+
+    void inc(uint64_t n = 1) { _value.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t value() const { return _value.load(std::memory_order_relaxed); }
+
+private:
+
+    std::atomic<uint64_t> _value{0};
+};
+
+class Gauge
+{
+
+public:
+
+    void set(int64_t v) { _value.store(v, std::memory_order_relaxed); }
+    void add(int64_t n) { _value.fetch_add(n, std::memory_order_relaxed); }
+    int64_t value() const { return _value.load(std::memory_order_relaxed); }
+
+private:
+
+    std::atomic<int64_t> _value{0};
+};
+
+class Histogram
+{
+
+public:
+
+    // Upper bounds in microseconds, shared by every histogram: 10 us to 10 s.
+    static constexpr size_t   kBuckets = 19;
+    static constexpr uint64_t kBoundsUs[kBuckets] = {
+        10, 25, 50, 100, 250, 500,
+        1000, 2500, 5000, 10000, 25000, 50000,
+        100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000,
+    };
+
+    void observeUs(uint64_t us) {
+        size_t i = 0;
+        while (i < kBuckets && us > kBoundsUs[i]) i++;
+        _counts[i].fetch_add(1, std::memory_order_relaxed); // i == kBuckets: +Inf
+        _sumUs.fetch_add(us, std::memory_order_relaxed);
+    }
+
+    // Non-cumulative count of bucket i (kBuckets is the +Inf overflow).
+    uint64_t bucket(size_t i) const { return _counts[i].load(std::memory_order_relaxed); }
+    uint64_t sumUs() const { return _sumUs.load(std::memory_order_relaxed); }
+
+private:
+
+    std::atomic<uint64_t> _counts[kBuckets + 1] = {};
+    std::atomic<uint64_t> _sumUs{0};
+};
+
+// Records the lifetime of the scope into a histogram.
+class ScopedTimer
+{
+
+public:
+
+    explicit ScopedTimer(Histogram &h) : _h(h), _start(std::chrono::steady_clock::now()) {}
+    ~ScopedTimer() {
+        _h.observeUs((uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - _start).count());
+    }
+
+    ScopedTimer(const ScopedTimer &) = delete;
+    ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+private:
+
+    Histogram &_h;
+    std::chrono::steady_clock::time_point _start;
+};
+
+class MetricsRegistry
+{
+
+public:
+
+    // Returns the metric called name, creating it on first use.
+    Counter   &counter(const char *name, const char *help);
+    Gauge     &gauge(const char *name, const char *help);
+    Histogram &histogram(const char *name, const char *help);
+
+    // A metric registered, with its help text, by the code that owns it. If
+    // the lookup comes first the help is filled in at registration.
+    Counter   &counter(const char *name) { return counter(name, ""); }
+    Gauge     &gauge(const char *name) { return gauge(name, ""); }
+    Histogram &histogram(const char *name) { return histogram(name, ""); }
+
+    // Prometheus text exposition format (version 0.0.4).
+    std::string prometheus() const;
+
+    // Flat JSON object: counters and gauges by name, histograms as
+    // <name>_count and <name>_sum (seconds).
+    std::string json() const;
+
+private:
+
+    enum class Kind { Counter, Gauge, Histogram };
+
+    struct Entry {
+        Entry(Kind k, const char *n, const char *h) : kind(k), name(n), help(h) {}
+
+        Kind        kind;
+        std::string name;
+        std::string help;
+        Counter     counter;
+        Gauge       gauge;
+        Histogram   histogram;
+    };
+
+    mutable std::mutex _mutex;
+    std::deque<Entry>  _entries; // deque: references stay valid as it grows
+
+    Entry &entry(Kind kind, const char *name, const char *help);
+};
+
+// The process-wide registry.
+MetricsRegistry &metrics();
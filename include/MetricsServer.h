@@ -0,0 +1,36 @@
+// include/MetricsServer.h
+#pragma once
+
+#include <cstdint>
+#include <thread>
+
+// Minimal HTTP server answering GET /metrics with metrics().prometheus().
+//
+// One thread, one request per connection; a scrape every few seconds is all
+// it needs to handle.
+class MetricsServer
+{
+
+public:
+
+    MetricsServer() = default;
+    ~MetricsServer();
+
+    // Listen on address:port, address an IPv4 literal ("0.0.0.0" for all
+    // interfaces). Returns false if the address is invalid or the socket
+    // could not be bound.
+    bool start(const char *address, uint16_t port);
+    void stop();
+
+private:
+
+    // Longest a client may take to send its request, and each send may block
+    static constexpr int kClientTimeoutMs = 1000;
+
+    int               _listenFd = -1;
+    int               _stopFd   = -1;
+    std::thread       _thread;
+
+    void run();
+    void serve(int fd);
+};
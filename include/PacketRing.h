@@ -0,0 +1,108 @@
+// include/PacketRing.h
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include "DieselHeaterRF.h"
+
+// Fixed-capacity, lock-free broadcast ring: one producer, any number of
+// independent readers.
+//
+// The producer never blocks; once the ring is full it overwrites the oldest
+// entry. Each Reader keeps its own cursor, so consumers (MQTT publisher,
+// pairing, capture) read at their own pace, and a reader that falls more
+// than N entries behind skips ahead and is told how many it missed. Every
+// slot carries a sequence number (seqlock), so a reader never returns an
+// entry the producer was overwriting while it copied.
+template <typename T, size_t N>
+class PacketRing
+{
+    static_assert(N > 0 && (N & (N - 1)) == 0, "capacity must be a power of two");
+    static_assert(std::is_trivially_copyable<T>::value, "entries are copied under a seqlock");
+
+public:
+
+    class Reader
+    {
+    public:
+        Reader() = default;
+
+        // Copy the next entry into out. Returns false if nothing new.
+        // dropped (optional) accumulates entries lost to overwrites.
+        bool pop(T &out, uint64_t *dropped = nullptr) {
+            if (!_ring) return false;
+            while (true) {
+                uint64_t head = _ring->_head.load(std::memory_order_acquire);
+                if (_next == head) return false;
+                if (head - _next > N) {
+                    if (dropped) *dropped += head - N - _next;
+                    _next = head - N;
+                }
+                const Slot &slot = _ring->_slots[_next & (N - 1)];
+                uint64_t seq1 = slot.seq.load(std::memory_order_acquire);
+                if (seq1 != 2 * _next + 2) {
+                    // Overwritten (or being overwritten) since head was read.
+                    if (seq1 > 2 * _next + 2) {
+                        if (dropped) (*dropped)++;
+                        _next++;
+                    }
+                    continue;
+                }
+                out = slot.value;
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (slot.seq.load(std::memory_order_relaxed) != seq1) continue;
+                _next++;
+                return true;
+            }
+        }
+
+        // Entries published but not yet read (capped at the ring capacity).
+        size_t pending() const {
+            if (!_ring) return 0;
+            uint64_t head = _ring->_head.load(std::memory_order_acquire);
+            return (size_t)(head - _next > N ? N : head - _next);
+        }
+
+    private:
+        friend class PacketRing;
+        Reader(const PacketRing *ring, uint64_t next) : _ring(ring), _next(next) {}
+
+        const PacketRing *_ring = nullptr;
+        uint64_t          _next = 0;
+    };
+
+    // Single producer only.
+    void push(const T &value) {
+        uint64_t h = _head.load(std::memory_order_relaxed);
+        Slot &slot = _slots[h & (N - 1)];
+        slot.seq.store(2 * h + 1, std::memory_order_relaxed); // Odd: write in progress
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.value = value;
+        slot.seq.store(2 * h + 2, std::memory_order_release);
+        _head.store(h + 1, std::memory_order_release);
+    }
+
+    // A reader that sees only entries pushed from now on.
+    Reader reader() const { return Reader(this, _head.load(std::memory_order_acquire)); }
+
+    // Total entries ever pushed.
+    uint64_t pushed() const { return _head.load(std::memory_order_acquire); }
+
+    static constexpr size_t capacity() { return N; }
+
+private:
+
+    struct Slot {
+        std::atomic<uint64_t> seq{0};
+        T value{};
+    };
+
+    Slot                  _slots[N];
+    std::atomic<uint64_t> _head{0};
+};
+
+// Received heater status frames, as filled by RadioWorker in streaming mode.
+using HeaterFrameRing = PacketRing<heater_frame_t, 64>;
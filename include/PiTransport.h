@@ -0,0 +1,70 @@
+// include/PiTransport.h
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+#include "CC1101Transport.h"
+#include "pi_gpio.h"
+#include "pi_spi.h"
+
+// CC1101 on the Raspberry Pi: spidev for the data, GPIO for CSn, CHIP_RDYn
+// (sampled on MISO) and GDO2.
+//
+// In hardware CS mode spidev's CE0 frames each transaction instead, and
+// CHIP_RDYn is taken from bit 7 of the status byte the chip returns: a
+// transaction clocked before the chip was ready is simply repeated. The SPI
+// path then makes no GPIO calls at all; GDO2 is still a GPIO.
+//
+// Either way, a chip that never signals ready within kChipReadyTimeoutUs
+// makes transfer() throw std::runtime_error.
+//
+// The spidev device is opened on the first begin(), not at construction, so
+// building the transport never touches hardware.
+class PiTransport : public CC1101Transport
+{
+
+public:
+
+    enum class CsMode { Gpio, Hardware };
+
+    static constexpr uint32_t kChipReadyTimeoutUs = 10000;
+
+    PiTransport(const char *device, uint32_t speedHz,
+                uint8_t sck, uint8_t miso, uint8_t mosi, uint8_t ss, uint8_t gdo2)
+        : _device(device), _speedHz(speedHz),
+          _pinSck(sck), _pinMiso(miso), _pinMosi(mosi), _pinSs(ss), _pinGdo2(gdo2) {}
+
+    // Choose how CS is driven; call before begin(). leadUs (hardware mode
+    // only) delays the first clock edge after CE0 asserts.
+    void setCsMode(CsMode mode, uint16_t leadUs = 0) {
+        _csMode = mode;
+        _leadUs = leadUs;
+    }
+    CsMode csMode() const { return _csMode; }
+
+    void begin() override;
+    void transfer(const uint8_t *tx, uint8_t *rx, size_t len) override;
+    void transferBatch(PiSPIBatch &batch) override;
+    bool waitForGdo2(uint32_t timeoutMs, int cancelFd) override;
+    bool setSpeed(uint32_t hz) override;
+    uint32_t speed() const override { return _speedHz; }
+    const char *name() const override;
+
+private:
+
+    const char *_device;
+    uint32_t    _speedHz;
+    uint8_t     _pinSck;
+    uint8_t     _pinMiso;
+    uint8_t     _pinMosi;
+    uint8_t     _pinSs;
+    uint8_t     _pinGdo2;
+    CsMode      _csMode = CsMode::Gpio;
+    uint16_t    _leadUs = 0;
+
+    std::unique_ptr<PiSPI> _spi;
+
+    PiSPI &spi();
+    void waitChipReady();
+};
@@ -0,0 +1,135 @@
+// include/RadioWorker.h
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#include "DieselHeaterRF.h"
+#include "PacketRing.h"
+
+// Single owner of the CC1101.
+//
+// Every radio operation (polls, commands, pairing) is queued here and run on
+// one thread, so the MQTT callback, the state loop and pairing never touch
+// the chip concurrently. Commands outrank polls: queueing a command while a
+// poll is listening interrupts the receive through an eventfd, so the command
+// goes on air within milliseconds instead of after the receive window.
+//
+// With a frame ring attached (setStreaming) the worker keeps the radio in
+// continuous RX whenever the queue is empty and pushes every CRC-valid frame
+// into the ring; any queued job interrupts the listen.
+class RadioWorker
+{
+
+public:
+
+    // Background is used internally for streaming receive.
+    enum class Priority : uint8_t { Command = 0, Poll = 1, Background = 2 };
+
+    explicit RadioWorker(DieselHeaterRF &heater);
+    ~RadioWorker();
+
+    void start();
+    void stop();
+
+    // Queue fn(heater) and return a future for its result.
+    template <typename F>
+    auto submit(Priority prio, F &&fn)
+        -> std::future<decltype(fn(std::declval<DieselHeaterRF &>()))> {
+        using R = decltype(fn(std::declval<DieselHeaterRF &>()));
+        auto task = std::make_shared<std::packaged_task<R(DieselHeaterRF &)>>(std::forward<F>(fn));
+        std::future<R> result = task->get_future();
+        enqueue(prio, [task](DieselHeaterRF &h) { (*task)(h); });
+        return result;
+    }
+
+    std::future<void> sendCommand(uint8_t cmd);
+    std::future<void> sendCommand(uint8_t cmd, uint32_t addr);
+
+    // DieselHeaterRF::sendCommandAcked with the default burst policy (see
+    // setAckPolicy). done, if set, runs on the radio thread with the outcome.
+    std::future<heater_ack_t> sendCommandAcked(uint8_t cmd, uint32_t addr,
+                                               std::function<bool(const heater_state_t &)> acked,
+                                               std::function<void(const heater_ack_t &)> done = nullptr);
+    // DieselHeaterRF::sendSteps with the same burst and listen policy.
+    std::future<heater_ack_t> sendSteps(uint8_t cmd, uint8_t count, uint32_t addr,
+                                        std::function<bool(const heater_state_t &)> reached,
+                                        std::function<void(const heater_ack_t &)> done = nullptr);
+    void setAckPolicy(uint8_t burstLen, uint8_t maxFrames, uint16_t listenMs) {
+        _ackBurst  = burstLen;
+        _ackFrames = maxFrames;
+        _ackListen = listenMs;
+    }
+    std::future<std::optional<heater_state_t>> getState(uint32_t timeout);
+    std::future<void> setAddress(uint32_t addr);
+
+    // Switch between continuous RX and Wake-on-Radio listening (see
+    // DieselHeaterRF::setWakeOnRadio); streaming resumes in the new mode.
+    std::future<void> setWakeOnRadio(bool enable, uint16_t periodMs, uint8_t rxTime);
+
+    // Listen continuously while idle, publishing frames into ring (or stop
+    // streaming with nullptr). notifyFd, if set, is an eventfd bumped after
+    // every frame pushed, so a reader can sleep in epoll instead of polling.
+    void setStreaming(HeaterFrameRing *ring, int notifyFd = -1);
+
+    // Jobs waiting to run (not counting the one in progress).
+    size_t queueDepth() const { return _depth.load(std::memory_order_relaxed); }
+
+    // Time from queueing a command to it starting on the radio.
+    uint32_t lastCommandLatencyUs() const { return _lastCmdLatencyUs.load(std::memory_order_relaxed); }
+    uint32_t maxCommandLatencyUs() const { return _maxCmdLatencyUs.load(std::memory_order_relaxed); }
+
+private:
+
+    struct Job {
+        Priority prio;
+        uint64_t seq;
+        std::chrono::steady_clock::time_point queued;
+        std::function<void(DieselHeaterRF &)> run;
+    };
+
+    struct JobOrder {
+        bool operator()(const Job &a, const Job &b) const {
+            if (a.prio != b.prio) return a.prio > b.prio;
+            return a.seq > b.seq;
+        }
+    };
+
+    DieselHeaterRF &_heater;
+    std::thread     _thread;
+    int             _cancelFd = -1;
+    std::atomic<bool> _stopping{false}; // Set by stop(); see DieselHeaterRF::setStopFlag
+
+    mutable std::mutex      _mutex;
+    std::condition_variable _cv;
+    std::priority_queue<Job, std::vector<Job>, JobOrder> _queue;
+    uint64_t _seq     = 0;
+    bool     _stop    = false;
+    bool     _busy    = false;
+    Priority _running = Priority::Poll;
+    HeaterFrameRing *_ring = nullptr;
+    int              _notifyFd = -1;
+
+    uint8_t  _ackBurst  = 2;
+    uint8_t  _ackFrames = HEATER_TX_REPEAT;
+    uint16_t _ackListen = 500;
+
+    std::atomic<size_t>   _depth{0};
+    std::atomic<uint32_t> _lastCmdLatencyUs{0};
+    std::atomic<uint32_t> _maxCmdLatencyUs{0};
+
+    void enqueue(Priority prio, std::function<void(DieselHeaterRF &)> run);
+    void run();
+    void drainCancel();
+    void streamOnce(HeaterFrameRing *ring, int notifyFd);
+};
@@ -0,0 +1,293 @@
+// include/StatePublisher.h
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "DeltaPublisher.h"
+#include "DieselHeaterRF.h"
+#include "TelemetryFormat.h"
+
+// Decoded heater state -> MQTT topics and payloads.
+//
+// Shared by the bridge and the capture replay tool, so a replayed capture
+// produces exactly the publishes the bridge made from the same frames: the
+// same paired addresses, batching (PendingState) and formatting. The caller
+// supplies the transport as a sink and the clock as nowMs.
+
+static const char *const HEATER_TOPIC_BASE = "home/diesel_heater/";
+
+// Paired heater addresses, one hex address per line
+static const char *const HEATER_ADDR_FILE = "/data/addr.txt";
+
+// The addresses in an address file, in pairing order. Single-heater mode
+// serves only the first.
+inline std::vector<uint32_t> load_address_file(const char *path, bool multi) {
+    std::vector<uint32_t> addrs;
+    std::ifstream f(path);
+    uint32_t addr = 0;
+    while (f >> std::hex >> addr)
+        if (addr != 0) addrs.push_back(addr);
+    if (!multi && addrs.size() > 1) addrs.resize(1);
+    return addrs;
+}
+
+// Per-heater topic tree rooted at base (see heater_topics()).
+struct HeaterTopics {
+    std::string id;
+    std::string name;
+
+    // High-level control topics
+    std::string power_c, power_s;
+    std::string mode_c, mode_s;
+
+    // Absolute targets, reached with pipelined UP/DOWN steps
+    std::string setpoint_c, pfreq_c;
+
+    // Low-level command topics
+    std::string cmd_wakeup, cmd_mode, cmd_power, cmd_up, cmd_down;
+
+    // Outcome of acknowledged commands
+    std::string cmd_result;
+
+    // Telemetry history range queries and their answers
+    std::string history_get, history_result;
+
+    // Radio link quality (JSON), about once a minute
+    std::string rx_quality;
+
+    // State and sensor topics
+    std::string state_raw, temp, volt, case_temp, pfreq, hstate, hstate_txt, rssi, setpoint;
+
+    // Discovery topics
+    std::string disc_power, disc_mode, disc_temp, disc_volt, disc_case,
+                disc_pfreq, disc_hstate, disc_htext, disc_rssi,
+                disc_setpoint, disc_pfreq_set, disc_freq_offset, disc_rx_success;
+
+    HeaterTopics(const std::string &base, const std::string &object_id,
+                 const std::string &display_name)
+        : id(object_id), name(display_name) {
+        power_c     = base + "power/set";
+        power_s     = base + "power/state";
+        mode_c      = base + "mode/set";
+        mode_s      = base + "mode/state";
+        setpoint_c  = base + "setpoint/set";
+        pfreq_c     = base + "pump_freq/set";
+        cmd_wakeup  = base + "cmd/wakeup";
+        cmd_mode    = base + "cmd/mode";
+        cmd_power   = base + "cmd/power";
+        cmd_up      = base + "cmd/up";
+        cmd_down    = base + "cmd/down";
+        cmd_result  = base + "cmd/result";
+        history_get    = base + "history/get";
+        history_result = base + "history/result";
+        rx_quality  = base + "rx_quality";
+        state_raw   = base + "state/raw";
+        temp        = base + "ambient_temp";
+        volt        = base + "voltage";
+        case_temp   = base + "case_temp";
+        pfreq       = base + "pump_freq";
+        hstate      = base + "state_code";
+        hstate_txt  = base + "state/text";
+        rssi        = base + "rssi";
+        setpoint    = base + "setpoint";
+
+        const std::string ha = "homeassistant/";
+        disc_power  = ha + "switch/" + id + "/power/config";
+        disc_mode   = ha + "select/" + id + "/mode/config";
+        disc_temp   = ha + "sensor/" + id + "/ambient_temp/config";
+        disc_volt   = ha + "sensor/" + id + "/voltage/config";
+        disc_case   = ha + "sensor/" + id + "/case_temp/config";
+        disc_pfreq  = ha + "sensor/" + id + "/pump_freq/config";
+        disc_hstate = ha + "sensor/" + id + "/state_code/config";
+        disc_htext  = ha + "sensor/" + id + "/state_text/config";
+        disc_rssi   = ha + "sensor/" + id + "/rssi/config";
+        disc_setpoint  = ha + "number/" + id + "/setpoint/config";
+        disc_pfreq_set = ha + "number/" + id + "/pump_freq_set/config";
+        disc_freq_offset = ha + "sensor/" + id + "/freq_offset/config";
+        disc_rx_success  = ha + "sensor/" + id + "/rx_success/config";
+    }
+};
+
+// In single-heater mode the tree is rooted at base with HA object id
+// "diesel_heater", exactly the historical layout; in multi-heater mode each
+// heater lives under base + "<addr>/" as "diesel_heater_<addr>".
+inline HeaterTopics heater_topics(const std::string &base, uint32_t addr, bool multi) {
+    if (!multi)
+        return HeaterTopics(base, "diesel_heater", "Diesel Heater");
+    char hex[9];
+    std::snprintf(hex, sizeof(hex), "%08x", addr);
+    return HeaterTopics(base + hex + "/", std::string("diesel_heater_") + hex,
+                        std::string("Diesel Heater ") + hex);
+}
+
+// What an incoming topic asks of the heater whose tree t is.
+enum class HeaterTopicKind { None, HistoryQuery, Command };
+
+inline HeaterTopicKind classify_topic(const HeaterTopics &t, const std::string &topic) {
+    if (topic == t.history_get) return HeaterTopicKind::HistoryQuery;
+    if (topic == t.power_c || topic == t.mode_c || topic == t.setpoint_c ||
+        topic == t.pfreq_c || topic == t.cmd_wakeup ||
+        topic == t.cmd_mode || topic == t.cmd_power || topic == t.cmd_up ||
+        topic == t.cmd_down)
+        return HeaterTopicKind::Command;
+    return HeaterTopicKind::None;
+}
+
+// Telemetry fields tracked by the delta publisher. The last two have no
+// topic of their own but feed state/raw.
+enum TelemetryField : size_t {
+    F_AMBIENT_TEMP, F_VOLTAGE, F_CASE_TEMP, F_PUMP_FREQ, F_STATE, F_RSSI,
+    F_POWER_STATE, F_SETPOINT, F_AUTO_MODE, F_POWER, F_FIELD_COUNT
+};
+
+// Delta publishing policy: MQTT_KEEPALIVE_S (full refresh interval, 0 =
+// publish everything every time, the default) and per-field MQTT_DEADBAND_*
+// values.
+struct DeltaPolicy {
+    double   deadband[F_FIELD_COUNT] = {};
+    uint32_t keepaliveMs = 0;
+
+    static DeltaPolicy fromEnv() {
+        DeltaPolicy p;
+        p.keepaliveMs = (uint32_t)env("MQTT_KEEPALIVE_S", 0) * 1000u;
+        p.deadband[F_AMBIENT_TEMP] = env("MQTT_DEADBAND_AMBIENT_TEMP", 0);
+        p.deadband[F_VOLTAGE]      = env("MQTT_DEADBAND_VOLTAGE", 0.2);
+        p.deadband[F_CASE_TEMP]    = env("MQTT_DEADBAND_CASE_TEMP", 1);
+        p.deadband[F_PUMP_FREQ]    = env("MQTT_DEADBAND_PUMP_FREQ", 0);
+        p.deadband[F_RSSI]         = env("MQTT_DEADBAND_RSSI", 3);
+        return p;
+    }
+
+    void apply(DeltaPublisher &d) const {
+        for (size_t f = 0; f < F_FIELD_COUNT; f++) d.setDeadband(f, deadband[f]);
+        d.setKeepalive(keepaliveMs);
+    }
+
+private:
+
+    static double env(const char *name, double fallback) {
+        const char *v = std::getenv(name);
+        if (!v || !*v) return fallback;
+        char *end = nullptr;
+        double d = std::strtod(v, &end);
+        return end != v ? d : fallback;
+    }
+};
+
+// Newest state heard from one heater. Received frames are drained in
+// batches: each frame from a paired heater overwrites its pending state, and
+// after the batch every heater with a new state publishes it once, in table
+// order. Frames from unpaired addresses are dropped before decoding.
+struct PendingState {
+    heater_state_t state{};
+    uint64_t       timestampUs = 0; // Receive time of state, us since the epoch
+    uint64_t       frames = 0;      // Status packets received in total
+    bool           dirty = false;
+
+    void offer(const char *frame, uint64_t receivedUs) {
+        DieselHeaterRF::decodeState(frame, &state);
+        timestampUs = receivedUs;
+        dirty = true;
+        frames++;
+    }
+
+    // True once per batch that brought a new state.
+    bool take() {
+        bool was = dirty;
+        dirty = false;
+        return was;
+    }
+};
+
+// Route one drained frame to the PendingState find(address) returns, or drop
+// it if that is nullptr. Returns whether the frame was kept.
+template <typename Find>
+bool offer_frame(Find &&find, const char *frame, uint64_t receivedUs) {
+    PendingState *p = find(DieselHeaterRF::parseAddress(frame));
+    if (!p) return false;
+    p->offer(frame, receivedUs);
+    return true;
+}
+
+inline bool heater_is_on(uint8_t state_code) {
+    switch (state_code) {
+        case HEATER_STATE_OFF:
+            return false;
+        case HEATER_STATE_SHUTDOWN:
+        case HEATER_STATE_SHUTTING_DOWN:
+        case HEATER_STATE_COOLING:
+            return false;
+        case HEATER_STATE_STARTUP:
+        case HEATER_STATE_WARMING:
+        case HEATER_STATE_WARMING_WAIT:
+        case HEATER_STATE_PRE_RUN:
+        case HEATER_STATE_RUNNING:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Publish one decoded state to a heater's sensor topics through
+// publish(topic, payload, len). Only fields that moved past their deadband go
+// out, except on keepalive cycles when everything is re-sent; state/raw
+// follows whenever anything changed. Topics are pre-built in HeaterTopics and
+// payloads are formatted into a stack buffer, so nothing here allocates.
+template <typename Sink>
+void publish_telemetry(Sink &&publish, const HeaterTopics &t, DeltaPublisher &d,
+                       const heater_state_t &st, uint32_t nowMs) {
+    bool is_on = heater_is_on(st.state);
+
+    PayloadBuffer buf;
+    d.beginCycle(nowMs);
+    if (d.changed(F_AMBIENT_TEMP, st.ambientTemp)) {
+        buf.clear();
+        buf.appendInt(st.ambientTemp);
+        publish(t.temp, buf.data(), buf.size());
+    }
+    if (d.changed(F_VOLTAGE, st.voltage)) {
+        buf.clear();
+        buf.appendFixed(st.voltage);
+        publish(t.volt, buf.data(), buf.size());
+    }
+    if (d.changed(F_CASE_TEMP, st.caseTemp)) {
+        buf.clear();
+        buf.appendInt(st.caseTemp);
+        publish(t.case_temp, buf.data(), buf.size());
+    }
+    if (d.changed(F_PUMP_FREQ, st.pumpFreq)) {
+        buf.clear();
+        buf.appendFixed(st.pumpFreq);
+        publish(t.pfreq, buf.data(), buf.size());
+    }
+    if (d.changed(F_STATE, st.state)) {
+        buf.clear();
+        buf.appendInt(st.state);
+        publish(t.hstate, buf.data(), buf.size());
+        const char *name = heater_state_name(st.state);
+        publish(t.hstate_txt, name, std::strlen(name));
+    }
+    if (d.changed(F_RSSI, st.rssi)) {
+        buf.clear();
+        buf.appendInt(st.rssi);
+        publish(t.rssi, buf.data(), buf.size());
+    }
+    if (d.changed(F_POWER_STATE, is_on))
+        publish(t.power_s, is_on ? "ON" : "OFF", is_on ? 2 : 3);
+    if (d.changed(F_SETPOINT, st.setpoint)) {
+        buf.clear();
+        buf.appendInt(st.setpoint);
+        publish(t.setpoint, buf.data(), buf.size());
+    }
+    d.changed(F_AUTO_MODE, st.autoMode);
+    d.changed(F_POWER, st.power);
+    if (!d.anyChanged()) return;
+
+    format_state_raw(buf, st);
+    publish(t.state_raw, buf.data(), buf.size());
+}
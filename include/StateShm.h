@@ -0,0 +1,149 @@
+// include/StateShm.h
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+
+#include "DieselHeaterRF.h"
+
+// Live heater state in a POSIX shared-memory segment (e.g. /dev/shm/diesel_heater),
+// for processes on the same host that want the latest reading without going
+// through the MQTT broker.
+//
+// The bridge is the only writer. Each heater has a slot guarded by a seqlock:
+// the sequence number is odd while the slot is being written, so a reader
+// copies the slot, checks the sequence did not move, and retries otherwise.
+// Reading takes no lock and no system call, and never delays the writer.
+// Both sides must be built from the same header: the version, slot size and
+// slot count are checked when a reader maps the segment.
+
+static constexpr uint32_t kStateShmVersion = 1;
+static constexpr size_t   kStateShmSlots   = 16;
+
+// One heater's latest state, as a reader receives it.
+struct StateShmSnapshot {
+    uint32_t       addr        = 0;
+    uint32_t       reserved    = 0;
+    uint64_t       timestampUs = 0; // Receive time of state, wall clock; 0 = none yet
+    uint64_t       frames      = 0; // Status packets received from this heater
+    heater_state_t state;
+};
+static_assert(std::is_trivially_copyable<StateShmSnapshot>::value, "copied under a seqlock");
+
+struct alignas(64) StateShmSlot {
+    std::atomic<uint64_t> seq{0}; // Odd: write in progress, 0: never written
+    StateShmSnapshot      snap;
+};
+
+struct StateShmHeader {
+    char                  magic[8];  // "DHSTATE"
+    uint32_t              version;
+    uint32_t              slotSize;
+    uint32_t              slotCount;
+    std::atomic<uint32_t> heaters;   // Slots in use
+    std::atomic<int32_t>  writerPid; // 0 once the bridge has exited
+    uint32_t              reserved;
+    // Bridge-wide radio counters, updated with every state
+    std::atomic<uint64_t> rxPackets;
+    std::atomic<uint64_t> rxCrcErrors;
+    std::atomic<uint64_t> updates;
+};
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared atomics must be lock-free");
+
+struct StateShmSegment {
+    StateShmHeader header;
+    StateShmSlot   slots[kStateShmSlots];
+};
+
+class StateShmWriter
+{
+
+public:
+
+    StateShmWriter() = default;
+    ~StateShmWriter();
+
+    StateShmWriter(const StateShmWriter &) = delete;
+    StateShmWriter &operator=(const StateShmWriter &) = delete;
+
+    // Create (or take over) the segment called name, e.g. "/diesel_heater".
+    // Returns false (with error set) if it cannot be created.
+    bool open(const std::string &name, std::string *error = nullptr);
+    // Mark the writer gone and unlink the segment; mapped readers keep the
+    // last state.
+    void close();
+    bool isOpen() const { return _seg != nullptr; }
+
+    void update(size_t slot, uint32_t addr, const heater_state_t &st,
+                uint64_t timestampUs, uint64_t frames);
+    // Hand slot to another heater that has sent nothing yet.
+    void reset(size_t slot, uint32_t addr) { update(slot, addr, heater_state_t{}, 0, 0); }
+    void setCounters(uint64_t rxPackets, uint64_t rxCrcErrors);
+
+private:
+
+    std::string      _name;
+    StateShmSegment *_seg = nullptr;
+};
+
+class StateShmReader
+{
+
+public:
+
+    StateShmReader() = default;
+    ~StateShmReader();
+
+    StateShmReader(const StateShmReader &) = delete;
+    StateShmReader &operator=(const StateShmReader &) = delete;
+
+    bool open(const std::string &name, std::string *error = nullptr);
+    void close();
+
+    // A write takes well under a microsecond. A slot still odd after
+    // kMaxBusySpins checks (about a millisecond) is given up on; every
+    // kBusyCheckSpins the writer is also checked for having died mid-write.
+    static constexpr uint32_t kBusyCheckSpins = 4096;
+    static constexpr uint32_t kMaxBusySpins   = 1u << 20;
+
+    const StateShmHeader &header() const { return _seg->header; }
+    size_t heaters() const { return _seg->header.heaters.load(std::memory_order_acquire); }
+
+    // False once the bridge has exited or was killed. Makes a system call.
+    bool writerAlive() const;
+
+    // Copy a consistent snapshot of slot. Returns false if the slot was never
+    // written, or if it stays mid-write: a writer killed between its two
+    // sequence stores leaves the slot odd for good (sequence() is then odd).
+    // retries (optional) accumulates copies torn by the writer.
+    bool read(size_t slot, StateShmSnapshot *out, uint64_t *retries = nullptr) const {
+        if (slot >= kStateShmSlots) return false;
+        const StateShmSlot &s = _seg->slots[slot];
+        uint32_t busy = 0;
+        while (true) {
+            uint64_t seq1 = s.seq.load(std::memory_order_acquire);
+            if (seq1 & 1) {
+                if (retries) (*retries)++;
+                if (++busy % kBusyCheckSpins == 0 && (busy >= kMaxBusySpins || !writerAlive()))
+                    return false;
+                continue;
+            }
+            *out = s.snap;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (s.seq.load(std::memory_order_relaxed) == seq1) return seq1 != 0;
+            if (retries) (*retries)++;
+        }
+    }
+
+    // Changes on every write to slot; cheap to poll for new data.
+    uint64_t sequence(size_t slot) const {
+        return _seg->slots[slot].seq.load(std::memory_order_acquire);
+    }
+
+private:
+
+    const StateShmSegment *_seg = nullptr;
+};
@@ -0,0 +1,103 @@
+// include/TelemetryFormat.h
+#pragma once
+
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "DieselHeaterRF.h"
+
+// Fixed-capacity text buffer for MQTT payloads. Appends never allocate;
+// anything past the capacity is dropped and flagged by overflowed().
+//
+// Numbers are rendered with std::to_chars in the same form std::to_string
+// produced before (integers in decimal, floats fixed with six decimals), so
+// payloads are byte-identical to the previous serialization.
+template <size_t N>
+class TextBuffer
+{
+
+public:
+
+    void clear() {
+        _len      = 0;
+        _overflow = false;
+    }
+
+    TextBuffer &append(const char *s, size_t n) {
+        if (n > N - _len) {
+            n         = N - _len;
+            _overflow = true;
+        }
+        std::memcpy(_buf + _len, s, n);
+        _len += n;
+        return *this;
+    }
+
+    TextBuffer &append(const char *s) { return append(s, std::strlen(s)); }
+
+    TextBuffer &appendInt(long long v) {
+        auto r = std::to_chars(_buf + _len, _buf + N, v);
+        if (r.ec != std::errc()) {
+            _overflow = true;
+            return *this;
+        }
+        _len = (size_t)(r.ptr - _buf);
+        return *this;
+    }
+
+    TextBuffer &appendFixed(double v, int precision = 6) {
+        auto r = std::to_chars(_buf + _len, _buf + N, v, std::chars_format::fixed, precision);
+        if (r.ec != std::errc()) {
+            _overflow = true;
+            return *this;
+        }
+        _len = (size_t)(r.ptr - _buf);
+        return *this;
+    }
+
+    const char *data() const { return _buf; }
+    size_t size() const { return _len; }
+    bool overflowed() const { return _overflow; }
+
+private:
+
+    char   _buf[N];
+    size_t _len      = 0;
+    bool   _overflow = false;
+};
+
+using PayloadBuffer = TextBuffer<256>;
+
+// Decode numeric state to text
+inline const char *heater_state_name(uint8_t code) {
+    switch (code) {
+        case HEATER_STATE_OFF:           return "off";
+        case HEATER_STATE_STARTUP:       return "startup";
+        case HEATER_STATE_WARMING:       return "warming";
+        case HEATER_STATE_WARMING_WAIT:  return "warming_wait";
+        case HEATER_STATE_PRE_RUN:       return "pre_run";
+        case HEATER_STATE_RUNNING:       return "running";
+        case HEATER_STATE_SHUTDOWN:      return "shutdown";
+        case HEATER_STATE_SHUTTING_DOWN: return "shutting_down";
+        case HEATER_STATE_COOLING:       return "cooling";
+        default:                         return "unknown";
+    }
+}
+
+// The state/raw JSON document.
+template <size_t N>
+void format_state_raw(TextBuffer<N> &out, const heater_state_t &st) {
+    out.clear();
+    out.append("{\"state\":").appendInt(st.state)
+       .append(",\"power\":").appendInt(st.power)
+       .append(",\"voltage\":").appendFixed(st.voltage)
+       .append(",\"ambientTemp\":").appendInt(st.ambientTemp)
+       .append(",\"caseTemp\":").appendInt(st.caseTemp)
+       .append(",\"setpoint\":").appendInt(st.setpoint)
+       .append(",\"autoMode\":").appendInt(st.autoMode)
+       .append(",\"pumpFreq\":").appendFixed(st.pumpFreq)
+       .append(",\"rssi\":").appendInt(st.rssi)
+       .append("}");
+}
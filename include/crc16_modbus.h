@@ -0,0 +1,110 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// CRC-16/MODBUS (reflected poly 0xA001, init 0xFFFF, no final XOR), as used
+// by the heater protocol for both status packets and commands.
+//
+// The lookup tables are generated at compile time. update() processes eight
+// bytes per step with slicing-by-8 and finishes byte-at-a-time, so it can be
+// fed incrementally (e.g. as bytes come out of the RX FIFO).
+namespace crc16 {
+
+constexpr uint16_t kPoly = 0xA001;
+constexpr uint16_t kInit = 0xFFFF;
+
+// Bit-serial reference: the original DieselHeaterRF::crc16_2 loop.
+constexpr uint16_t updateBitwise(uint16_t crc, const uint8_t *buf, size_t len) {
+    for (size_t pos = 0; pos < len; pos++) {
+        crc ^= buf[pos];
+        for (int i = 8; i != 0; i--) {
+            if ((crc & 0x0001) != 0) {
+                crc >>= 1;
+                crc ^= kPoly;
+            } else {
+                crc >>= 1;
+            }
+        }
+    }
+    return crc;
+}
+
+using Tables = std::array<std::array<uint16_t, 256>, 8>;
+
+// tables[0] is the classic byte table; tables[k] advances a byte followed by
+// k zero bytes, which is what slicing-by-8 needs for the earlier lanes.
+constexpr Tables makeTables() {
+    Tables t{};
+    for (int i = 0; i < 256; i++) {
+        uint8_t b = static_cast<uint8_t>(i);
+        t[0][i] = updateBitwise(0, &b, 1);
+    }
+    for (int k = 1; k < 8; k++)
+        for (int i = 0; i < 256; i++)
+            t[k][i] = static_cast<uint16_t>((t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xFF]);
+    return t;
+}
+
+inline constexpr Tables kTables = makeTables();
+
+constexpr uint16_t updateByte(uint16_t crc, uint8_t b) {
+    return static_cast<uint16_t>((crc >> 8) ^ kTables[0][(crc ^ b) & 0xFF]);
+}
+
+constexpr uint16_t update(uint16_t crc, const uint8_t *buf, size_t len) {
+    while (len >= 8) {
+        crc ^= static_cast<uint16_t>(buf[0] | (buf[1] << 8));
+        crc = static_cast<uint16_t>(kTables[7][crc & 0xFF] ^ kTables[6][crc >> 8] ^
+                                    kTables[5][buf[2]] ^ kTables[4][buf[3]] ^
+                                    kTables[3][buf[4]] ^ kTables[2][buf[5]] ^
+                                    kTables[1][buf[6]] ^ kTables[0][buf[7]]);
+        buf += 8;
+        len -= 8;
+    }
+    while (len--)
+        crc = updateByte(crc, *buf++);
+    return crc;
+}
+
+constexpr uint16_t compute(const uint8_t *buf, size_t len) {
+    return update(kInit, buf, len);
+}
+
+// Incremental form for streaming callers.
+class Crc16Modbus {
+public:
+    constexpr void update(const uint8_t *buf, size_t len) { crc_ = crc16::update(crc_, buf, len); }
+    constexpr void update(uint8_t b) { crc_ = updateByte(crc_, b); }
+    constexpr uint16_t value() const { return crc_; }
+    constexpr void reset() { crc_ = kInit; }
+
+private:
+    uint16_t crc_ = kInit;
+};
+
+// Compile-time proof that the table paths match the bit-serial reference.
+namespace detail {
+
+constexpr uint8_t kCheckInput[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+
+constexpr bool slicedMatchesBitwise() {
+    uint8_t buf[61] = {};
+    for (size_t i = 0; i < sizeof(buf); i++)
+        buf[i] = static_cast<uint8_t>(i * 37 + 11);
+    for (size_t len = 0; len <= sizeof(buf); len++) {
+        if (compute(buf, len) != updateBitwise(kInit, buf, len)) return false;
+        Crc16Modbus inc;
+        inc.update(buf, len / 3);
+        for (size_t i = len / 3; i < len; i++) inc.update(buf[i]);
+        if (inc.value() != updateBitwise(kInit, buf, len)) return false;
+    }
+    return true;
+}
+
+static_assert(compute(kCheckInput, sizeof(kCheckInput)) == 0x4B37, "CRC-16/MODBUS check value");
+static_assert(slicedMatchesBitwise(), "table CRC must be bit-identical to the bit-serial loop");
+
+} // namespace detail
+
+} // namespace crc16
@@ -7,6 +7,12 @@
 #include <string>
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+
+#include "pi_arduino_compat.h"
+#include "pi_syscalls.h"
 
 // Logical constants, mapped onto sysfs semantics.
 constexpr int PI_INPUT  = 0;
@@ -14,10 +20,17 @@ constexpr int PI_OUTPUT = 1;
 constexpr int PI_LOW    = 0;
 constexpr int PI_HIGH   = 1;
 
+// ---- sysfs backend ----
+//
+// Every access opens, reads/writes and closes a file under /sys/class/gpio.
+// Kept as the fallback for kernels without the GPIO character device.
+
 // Helper: write a string to a file.
 inline bool gpioWriteFile(const char *path, const char *value) {
+    piCountSyscalls(1);
     int fd = ::open(path, O_WRONLY);
     if (fd < 0) return false;
+    piCountSyscalls(2);
     ssize_t n = ::write(fd, value, std::strlen(value));
     ::close(fd);
     return n == (ssize_t)std::strlen(value);
@@ -49,8 +62,10 @@ inline bool gpioSetValue(int pin, int value) {
 inline int gpioGetValue(int pin) {
     char path[64];
     std::snprintf(path, sizeof(path), "/sys/class/gpio/gpio%d/value", pin);
+    piCountSyscalls(1);
     int fd = ::open(path, O_RDONLY);
     if (fd < 0) return 0;
+    piCountSyscalls(2);
     char ch = '0';
     if (::read(fd, &ch, 1) != 1) {
         ::close(fd);
@@ -60,18 +75,235 @@ inline int gpioGetValue(int pin) {
     return (ch == '0') ? 0 : 1;
 }
 
+// ---- Character-device backend ----
+//
+// Each line is requested once from /dev/gpiochipN and the returned handle fd
+// is kept, so a read or write afterwards is a single ioctl.  The chip path
+// can be overridden with PI_GPIO_CHIP (e.g. /dev/gpiochip4 on a Pi 5), and
+// PI_GPIO_BACKEND=sysfs forces the sysfs backend.
+
+struct PiGpioLines {
+    static constexpr int kMaxPins = 64;
+
+    int  chipFd = -1;
+    bool probed = false;
+    int  fd[kMaxPins];
+    int  mode[kMaxPins];
+    bool events[kMaxPins];   // fd is a line event fd (rising edges queued)
+    int  sysfsFd[kMaxPins];  // Persistent sysfs value fd for edge waits
+
+    PiGpioLines() {
+        for (int i = 0; i < kMaxPins; i++) {
+            fd[i]      = -1;
+            mode[i]    = -1;
+            events[i]  = false;
+            sysfsFd[i] = -1;
+        }
+    }
+
+    ~PiGpioLines() {
+        for (int i = 0; i < kMaxPins; i++) {
+            if (fd[i] >= 0) ::close(fd[i]);
+            if (sysfsFd[i] >= 0) ::close(sysfsFd[i]);
+        }
+        if (chipFd >= 0) ::close(chipFd);
+    }
+};
+
+inline PiGpioLines &gpioLines() {
+    static PiGpioLines lines;
+    return lines;
+}
+
+// Open the GPIO chip on first use. Returns -1 when the sysfs backend is in use.
+inline int gpioChipFd() {
+    PiGpioLines &l = gpioLines();
+    if (!l.probed) {
+        l.probed = true;
+        const char *backend = std::getenv("PI_GPIO_BACKEND");
+        if (!(backend && std::strcmp(backend, "sysfs") == 0)) {
+            const char *chip = std::getenv("PI_GPIO_CHIP");
+            piCountSyscalls(1);
+            l.chipFd = ::open((chip && *chip) ? chip : "/dev/gpiochip0", O_RDONLY | O_CLOEXEC);
+        }
+    }
+    return l.chipFd;
+}
+
+// Request (or re-request) a line handle for pin. Returns false if the chip
+// refused it, in which case the pin falls back to sysfs.
+inline bool gpioChipRequestLine(int pin, bool isOutput) {
+    PiGpioLines &l = gpioLines();
+    int chip = gpioChipFd();
+    if (chip < 0 || pin < 0 || pin >= PiGpioLines::kMaxPins) return false;
+
+    int mode = isOutput ? PI_OUTPUT : PI_INPUT;
+    if (l.fd[pin] >= 0 && l.mode[pin] == mode && !l.events[pin]) return true;
+    if (l.fd[pin] >= 0) {
+        piCountSyscalls(1);
+        ::close(l.fd[pin]);
+        l.fd[pin]     = -1;
+        l.events[pin] = false;
+    }
+
+    struct gpiohandle_request req;
+    std::memset(&req, 0, sizeof(req));
+    req.lineoffsets[0]    = static_cast<uint32_t>(pin);
+    req.lines             = 1;
+    req.flags             = isOutput ? GPIOHANDLE_REQUEST_OUTPUT : GPIOHANDLE_REQUEST_INPUT;
+    req.default_values[0] = 0; // Same as writing "out" to sysfs direction
+    std::strncpy(req.consumer_label, "diesel_heater", sizeof(req.consumer_label) - 1);
+
+    piCountSyscalls(1);
+    if (::ioctl(chip, GPIO_GET_LINEHANDLE_IOCTL, &req) < 0) return false;
+
+    l.fd[pin]   = req.fd;
+    l.mode[pin] = mode;
+    return true;
+}
+
+// Request pin as an input that queues rising-edge events. The event fd also
+// answers GPIOHANDLE_GET_LINE_VALUES_IOCTL, so digitalReadPi keeps working.
+inline bool gpioChipRequestEvents(int pin) {
+    PiGpioLines &l = gpioLines();
+    int chip = gpioChipFd();
+    if (chip < 0 || pin < 0 || pin >= PiGpioLines::kMaxPins) return false;
+    if (l.fd[pin] >= 0 && l.events[pin]) return true;
+    if (l.fd[pin] >= 0) {
+        piCountSyscalls(1);
+        ::close(l.fd[pin]);
+        l.fd[pin] = -1;
+    }
+
+    struct gpioevent_request req;
+    std::memset(&req, 0, sizeof(req));
+    req.lineoffset  = static_cast<uint32_t>(pin);
+    req.handleflags = GPIOHANDLE_REQUEST_INPUT;
+    req.eventflags  = GPIOEVENT_REQUEST_RISING_EDGE;
+    std::strncpy(req.consumer_label, "diesel_heater", sizeof(req.consumer_label) - 1);
+
+    piCountSyscalls(1);
+    if (::ioctl(chip, GPIO_GET_LINEEVENT_IOCTL, &req) < 0) return false;
+
+    l.fd[pin]     = req.fd;
+    l.mode[pin]   = PI_INPUT;
+    l.events[pin] = true;
+    return true;
+}
+
+// Handle fd for pin, or -1 if the pin is served by sysfs.
+inline int gpioLineFd(int pin) {
+    if (pin < 0 || pin >= PiGpioLines::kMaxPins) return -1;
+    return gpioLines().fd[pin];
+}
+
 // Public API used by DieselHeaterRF.cpp
 
 inline void pinModePi(int pin, int mode) {
+    if (gpioChipRequestLine(pin, mode == PI_OUTPUT)) return;
     // Best-effort: ignore export errors if already exported.
     gpioExport(pin);
     gpioSetDirection(pin, mode == PI_OUTPUT);
 }
 
 inline void digitalWritePi(int pin, int value) {
+    int fd = gpioLineFd(pin);
+    if (fd >= 0) {
+        struct gpiohandle_data data;
+        std::memset(&data, 0, sizeof(data));
+        data.values[0] = value != 0;
+        piCountSyscalls(1);
+        ::ioctl(fd, GPIOHANDLE_SET_LINE_VALUES_IOCTL, &data);
+        return;
+    }
     gpioSetValue(pin, value != 0);
 }
 
 inline int digitalReadPi(int pin) {
+    int fd = gpioLineFd(pin);
+    if (fd >= 0) {
+        struct gpiohandle_data data;
+        std::memset(&data, 0, sizeof(data));
+        piCountSyscalls(1);
+        if (::ioctl(fd, GPIOHANDLE_GET_LINE_VALUES_IOCTL, &data) < 0) return 0;
+        return data.values[0] ? 1 : 0;
+    }
     return gpioGetValue(pin);
 }
+
+// Configure pin as an input whose rising edges can be waited on with
+// waitForHighPi(). Uses a line event fd, or the sysfs "edge" file and a
+// persistent value fd when the character device is unavailable.
+inline void pinEdgePi(int pin) {
+    if (gpioChipRequestEvents(pin)) return;
+    pinModePi(pin, PI_INPUT);
+    if (pin < 0 || pin >= PiGpioLines::kMaxPins) return;
+
+    char path[64];
+    std::snprintf(path, sizeof(path), "/sys/class/gpio/gpio%d/edge", pin);
+    if (!gpioWriteFile(path, "rising")) return;
+
+    PiGpioLines &l = gpioLines();
+    if (l.sysfsFd[pin] < 0) {
+        std::snprintf(path, sizeof(path), "/sys/class/gpio/gpio%d/value", pin);
+        piCountSyscalls(1);
+        l.sysfsFd[pin] = ::open(path, O_RDONLY | O_CLOEXEC);
+    }
+}
+
+// Returns true if fd (e.g. an eventfd used to interrupt a wait) is readable.
+inline bool fdReadablePi(int fd) {
+    if (fd < 0) return false;
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    return ::poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN);
+}
+
+// Block until pin reads high or timeoutMs elapses, sleeping in poll() on the
+// kernel edge event rather than spinning. Returns true if the pin is high.
+// If cancelFd becomes readable the wait ends early and returns false; the fd
+// is left for the caller to drain. Pins without edge support (see pinEdgePi)
+// fall back to polling the level.
+inline bool waitForHighPi(int pin, uint32_t timeoutMs, int cancelFd = -1) {
+    PiGpioLines &l = gpioLines();
+    bool chipEvents = pin >= 0 && pin < PiGpioLines::kMaxPins && l.events[pin];
+    int  sysfsFd    = (pin >= 0 && pin < PiGpioLines::kMaxPins) ? l.sysfsFd[pin] : -1;
+    uint32_t start  = millis();
+
+    while (true) {
+        uint32_t elapsed = millis() - start;
+        struct pollfd pfd[2] = { { -1, 0, 0 }, { cancelFd, POLLIN, 0 } };
+
+        if (chipEvents) {
+            if (digitalReadPi(pin)) return true;
+            if (elapsed >= timeoutMs) return false;
+            pfd[0] = { l.fd[pin], POLLIN, 0 };
+        } else if (sysfsFd >= 0) {
+            // Reading the value re-arms the sysfs edge notification.
+            char ch = '0';
+            piCountSyscalls(2);
+            ::lseek(sysfsFd, 0, SEEK_SET);
+            if (::read(sysfsFd, &ch, 1) == 1 && ch != '0') return true;
+            if (elapsed >= timeoutMs) return false;
+            pfd[0] = { sysfsFd, POLLPRI | POLLERR, 0 };
+        } else {
+            if (digitalReadPi(pin)) return true;
+            if (elapsed >= timeoutMs) return false;
+            if (fdReadablePi(cancelFd)) return false;
+            continue;
+        }
+
+        piCountSyscalls(1);
+        int n = ::poll(pfd, cancelFd >= 0 ? 2 : 1, (int)(timeoutMs - elapsed));
+        if (n > 0 && (pfd[1].revents & POLLIN)) return false;
+        if (n > 0 && chipEvents && (pfd[0].revents & POLLIN)) {
+            struct gpioevent_data ev;
+            piCountSyscalls(1);
+            (void)::read(l.fd[pin], &ev, sizeof(ev)); // Consume the edge
+        }
+    }
+}
+
+// Name of the backend serving pin, for logging.
+inline const char *gpioBackendName(int pin) {
+    return gpioLineFd(pin) >= 0 ? "gpiochip" : "sysfs";
+}
@@ -1,4 +1,5 @@
 #pragma once
+#include <algorithm>
 #include <cstdint>
 #include <cstddef>
 #include <stdexcept>
@@ -8,13 +9,62 @@
 #include <unistd.h>
 #include <cstring>
 
+#include "pi_syscalls.h"
+
+// A queue of CC1101 operations submitted together as one SPI_IOC_MESSAGE(n).
+//
+// Each add() becomes its own spi_ioc_transfer with cs_change set between
+// transfers, so when CE0 is wired to CSn (hardware CS) it frames every
+// operation while the whole sequence costs a single ioctl. With CS on a GPIO,
+// cs_change does not reach the chip and the operations must be sent one
+// transfer at a time (see PiTransport::transferBatch). Received bytes for
+// operation i are available through rx(i) after the batch is sent.
+class PiSPIBatch {
+public:
+    static constexpr size_t kMaxOps   = 16;
+    static constexpr size_t kMaxBytes = 128;
+
+    // Queue len bytes (copied). Returns false if the batch is full.
+    bool add(const uint8_t *tx, size_t len) {
+        if (ops_ >= kMaxOps || used_ + len > kMaxBytes || len == 0) return false;
+        std::memcpy(tx_ + used_, tx, len);
+        offset_[ops_] = used_;
+        len_[ops_]    = len;
+        used_ += len;
+        ops_++;
+        return true;
+    }
+
+    size_t size() const { return ops_; }
+    const uint8_t *tx(size_t i) const { return tx_ + offset_[i]; }
+    const uint8_t *rx(size_t i) const { return rx_ + offset_[i]; }
+    uint8_t *rx(size_t i) { return rx_ + offset_[i]; }
+    size_t len(size_t i) const { return len_[i]; }
+
+    void clear() {
+        ops_  = 0;
+        used_ = 0;
+    }
+
+private:
+    friend class PiSPI;
+
+    size_t  ops_  = 0;
+    size_t  used_ = 0;
+    size_t  offset_[kMaxOps];
+    size_t  len_[kMaxOps];
+    uint8_t tx_[kMaxBytes];
+    uint8_t rx_[kMaxBytes];
+};
+
 // Simple singleton-style SPI instance.
 //
-// CS is managed manually via GPIO in the CC1101 primitives so that the
-// CHIP_RDYn (MISO) signal can be sampled before the first clock edge.
-// SPI_MODE_0 (without SPI_NO_CS) is used so the hardware CE0 line also
+// By default CS is managed manually via GPIO in the CC1101 primitives so
+// that the CHIP_RDYn (MISO) signal can be sampled before the first clock
+// edge. SPI_MODE_0 (without SPI_NO_CS) is used so the hardware CE0 line also
 // tracks CS — this is harmless because each transfer_buf call is one
-// atomic SPI_IOC_MESSAGE covering the full CC1101 transaction.
+// atomic SPI_IOC_MESSAGE covering the full CC1101 transaction, and it lets
+// PiTransport rely on CE0 alone (hardware CS mode).
 class PiSPI {
     int fd_;
     uint32_t speed_;
@@ -41,21 +91,72 @@ public:
         if (fd_ >= 0) ::close(fd_);
     }
 
+    // Change the SPI clock for subsequent transfers. The controller rounds
+    // it down to a clock it can generate.
+    void setSpeed(uint32_t speed) {
+        if (ioctl(fd_, SPI_IOC_WR_MAX_SPEED_HZ, &speed) < 0)
+            throw std::runtime_error("SPI_IOC_WR_MAX_SPEED_HZ failed");
+        speed_ = speed;
+    }
+
+    uint32_t speed() const { return speed_; }
+
     // Transfer len bytes atomically in a single SPI_IOC_MESSAGE call.
-    // CS must be managed externally (assert before, deassert after).
-    void transfer_buf(const uint8_t *tx, uint8_t *rx, size_t len) {
-        struct spi_ioc_transfer tr;
-        std::memset(&tr, 0, sizeof(tr));
-        tr.tx_buf        = (unsigned long)tx;
-        tr.rx_buf        = (unsigned long)rx;
-        tr.len           = len;
-        tr.speed_hz      = speed_;
-        tr.bits_per_word = 8;
-        tr.delay_usecs   = 0;
-        if (ioctl(fd_, SPI_IOC_MESSAGE(1), &tr) < 1)
+    // With GPIO CS, CS must be managed externally (assert before, deassert
+    // after). leadUs > 0 holds CE0 asserted that long before the first clock
+    // edge, as an empty transfer in the same message.
+    void transfer_buf(const uint8_t *tx, uint8_t *rx, size_t len, uint16_t leadUs = 0) {
+        struct spi_ioc_transfer tr[2];
+        std::memset(tr, 0, sizeof(tr));
+        size_t n = 0;
+        if (leadUs) {
+            tr[n].speed_hz    = speed_;
+            tr[n].delay_usecs = leadUs;
+            n++;
+        }
+        tr[n].tx_buf        = (unsigned long)tx;
+        tr[n].rx_buf        = (unsigned long)rx;
+        tr[n].len           = len;
+        tr[n].speed_hz      = speed_;
+        tr[n].bits_per_word = 8;
+        tr[n].delay_usecs   = 0;
+        n++;
+        unsigned long req = _IOC(_IOC_WRITE, SPI_IOC_MAGIC, 0, SPI_MSGSIZE(n));
+        piCountSyscalls(1);
+        if (ioctl(fd_, req, tr) < 1)
             throw std::runtime_error("SPI transfer failed");
     }
-};
 
-// Global SPI instance, used by DieselHeaterRF.cpp and main.cpp.
-extern PiSPI g_spi;
+    // Transfer every queued operation of batch in one SPI_IOC_MESSAGE(n),
+    // CE0 toggling between operations. Only correct when CE0 is the chip's
+    // CSn; a CS held on a GPIO would merge the operations into one CC1101
+    // transaction. leadUs delays the first operation, as for transfer_buf.
+    // first and count select a run of the batch's operations.
+    void transfer_batch(PiSPIBatch &batch, uint16_t leadUs = 0,
+                        size_t first = 0, size_t count = PiSPIBatch::kMaxOps) {
+        if (first >= batch.ops_) return;
+        size_t ops = std::min(count, batch.ops_ - first);
+        struct spi_ioc_transfer tr[PiSPIBatch::kMaxOps + 1];
+        std::memset(tr, 0, sizeof(tr));
+        size_t n = 0;
+        if (leadUs) {
+            tr[n].speed_hz    = speed_;
+            tr[n].delay_usecs = leadUs;
+            n++;
+        }
+        for (size_t i = 0; i < ops; i++, n++) {
+            size_t op = first + i;
+            tr[n].tx_buf        = (unsigned long)(batch.tx_ + batch.offset_[op]);
+            tr[n].rx_buf        = (unsigned long)(batch.rx_ + batch.offset_[op]);
+            tr[n].len           = batch.len_[op];
+            tr[n].speed_hz      = speed_;
+            tr[n].bits_per_word = 8;
+            tr[n].cs_change     = (i + 1 < ops) ? 1 : 0; // Toggle CE0 between operations
+        }
+        // SPI_IOC_MESSAGE(n) spelled out so n may be a runtime value.
+        unsigned long req = _IOC(_IOC_WRITE, SPI_IOC_MAGIC, 0, SPI_MSGSIZE(n));
+        piCountSyscalls(1);
+        if (ioctl(fd_, req, tr) < 1)
+            throw std::runtime_error("SPI batch transfer failed");
+    }
+};
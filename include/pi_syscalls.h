@@ -0,0 +1,15 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+// Running count of the GPIO and SPI syscalls issued by the pi_* helpers.
+// Sample it before and after an operation to see what that operation cost.
+inline std::atomic<uint64_t> g_piSyscalls{0};
+
+inline void piCountSyscalls(uint32_t n = 1) {
+    g_piSyscalls.fetch_add(n, std::memory_order_relaxed);
+}
+
+inline uint64_t piSyscallCount() {
+    return g_piSyscalls.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,574 @@
+/*
+ * CC1101Sim.cpp
+ *
+ * In-process CC1101 model with simulated heaters on air.
+ */
+
+#include "CC1101Sim.h"
+#include "DieselHeaterRF.h"
+#include "crc16_modbus.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+// MARCSTATE values used by the model.
+static constexpr uint8_t MARC_SLEEP     = 0x00;
+static constexpr uint8_t MARC_IDLE      = 0x01;
+static constexpr uint8_t MARC_RX        = 0x0D;
+static constexpr uint8_t MARC_RX_OVF    = 0x11;
+static constexpr uint8_t MARC_FSTXON    = 0x12;
+static constexpr uint8_t MARC_TX        = 0x13;
+static constexpr uint8_t MARC_TX_UNF    = 0x16;
+
+// Configuration register reset values (datasheet table 43).
+static const uint8_t kResetRegs[0x2F] = {
+  0x29, 0x2E, 0x3F, 0x07, 0xD3, 0x91, 0xFF, 0x04, // 0x00-0x07
+  0x45, 0x00, 0x00, 0x0F, 0x00, 0x1E, 0xC4, 0xEC, // 0x08-0x0F
+  0x8C, 0x22, 0x02, 0x22, 0xF8, 0x47, 0x07, 0x30, // 0x10-0x17
+  0x04, 0x36, 0x6C, 0x03, 0x40, 0x91, 0x87, 0x6B, // 0x18-0x1F
+  0xF8, 0x56, 0x10, 0xA9, 0x0A, 0x20, 0x0D, 0x41, // 0x20-0x27
+  0x00, 0x59, 0x7F, 0x3F, 0x88, 0x31, 0x0B,       // 0x28-0x2E
+};
+
+static double env_double(const char *name, double fallback) {
+    const char *v = std::getenv(name);
+    if (!v || !*v) return fallback;
+    char *end = nullptr;
+    double d = std::strtod(v, &end);
+    return end != v ? d : fallback;
+}
+
+CC1101Sim::Config CC1101Sim::Config::fromEnv() {
+    Config c;
+    const char *list = std::getenv("SIM_HEATERS");
+    if (!list || !*list) list = "12345678";
+    for (const char *p = list; *p;) {
+        char *end = nullptr;
+        unsigned long addr = std::strtoul(p, &end, 16);
+        if (end == p) {
+            p++;
+            continue;
+        }
+        if (addr != 0) c.heaters.push_back(static_cast<uint32_t>(addr));
+        p = end;
+    }
+    c.rateHz       = env_double("SIM_RATE_HZ", c.rateHz);
+    c.corruptRate  = env_double("SIM_CORRUPT", c.corruptRate);
+    c.dropRate     = env_double("SIM_DROP", c.dropRate);
+    c.rssiDbm      = (int)env_double("SIM_RSSI_DBM", c.rssiDbm);
+    c.spiLatencyUs = (uint32_t)env_double("SIM_SPI_LATENCY_US", c.spiLatencyUs);
+    c.spiMaxHz     = (uint32_t)env_double("SIM_SPI_MAX_HZ", c.spiMaxHz);
+    c.seed         = (uint32_t)env_double("SIM_SEED", c.seed);
+    c.freqOffsetKhz      = env_double("SIM_FREQ_OFFSET_KHZ", c.freqOffsetKhz);
+    c.freqDriftKhzPerMin = env_double("SIM_FREQ_DRIFT_KHZ_PER_MIN", c.freqDriftKhzPerMin);
+    return c;
+}
+
+CC1101Sim::CC1101Sim(const Config &config) : _config(config), _rng(config.seed) {
+    _gdoFd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (_gdoFd < 0)
+        throw std::runtime_error("eventfd failed");
+    reset();
+
+    // Stagger the heaters over one broadcast period.
+    Clock::time_point now = Clock::now();
+    _start = now;
+    std::uniform_real_distribution<double> phase(0.0, 1.0);
+    for (uint32_t addr : _config.heaters) {
+        Heater h;
+        h.addr       = addr;
+        h.phaseEnd   = Clock::time_point::max();
+        h.lastUpdate = now;
+        h.nextTx     = now + std::chrono::duration_cast<Clock::duration>(period() * phase(_rng));
+        _heaters.push_back(h);
+    }
+}
+
+CC1101Sim::~CC1101Sim() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _cv.notify_all();
+    if (_air.joinable()) _air.join();
+    if (_gdoFd >= 0) ::close(_gdoFd);
+}
+
+void CC1101Sim::begin() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_air.joinable()) _air = std::thread(&CC1101Sim::airLoop, this);
+}
+
+void CC1101Sim::transfer(const uint8_t *tx, uint8_t *rx, size_t len) {
+    if (_config.spiLatencyUs)
+        std::this_thread::sleep_for(std::chrono::microseconds(_config.spiLatencyUs));
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    Clock::time_point now = Clock::now();
+    settle(now);
+
+    bool fifoRead = false;
+    size_t i = 0;
+    while (i < len) {
+        uint8_t hdr   = tx[i];
+        bool    read  = hdr & 0x80;
+        bool    burst = hdr & 0x40;
+        uint8_t addr  = hdr & 0x3F;
+        rx[i++] = statusByte(read);
+
+        if (addr >= 0x30 && addr <= 0x3D) {
+            // Burst read selects a status register; anything else is a strobe
+            // and the next byte is a new header.
+            if (read && burst) {
+                if (i < len) rx[i++] = readStatus(addr);
+            } else {
+                strobe(addr, now);
+            }
+            continue;
+        }
+
+        size_t n = burst ? len - i : (i < len ? 1 : 0);
+        for (size_t k = 0; k < n; k++, i++) {
+            if (addr == 0x3F) {        // FIFO
+                if (read) {
+                    rx[i]    = popRx();
+                    fifoRead = true;
+                } else {
+                    if (_txLen < kFifoSize) _txFifo[_txLen++] = tx[i];
+                    rx[i] = statusByte(false);
+                }
+            } else if (addr == 0x3E) { // PATABLE
+                if (read) {
+                    rx[i] = _paTable[k & 7];
+                } else {
+                    _paTable[k & 7] = tx[i];
+                    rx[i] = statusByte(false);
+                }
+            } else {
+                size_t a = addr + k;
+                if (read) {
+                    rx[i] = a < sizeof(_regs) ? _regs[a] : 0;
+                } else {
+                    if (a < sizeof(_regs)) _regs[a] = tx[i];
+                    rx[i] = statusByte(false);
+                }
+            }
+        }
+    }
+
+    // A further packet queued behind the one just read asserts GDO2 again.
+    if (fifoRead && _rxPartial == 0 && _rxLen > 0) raiseGdo2();
+
+    // Clocked too fast for the wiring: MISO is sampled before it settles and
+    // about one byte in 20 comes back with a bit flipped.
+    if (_config.spiMaxHz && _speedHz > _config.spiMaxHz) {
+        std::uniform_int_distribution<int> pick(0, 159);
+        for (size_t k = 0; k < len; k++) {
+            int b = pick(_rng);
+            if (b < 8) rx[k] ^= uint8_t(1 << b);
+        }
+    }
+}
+
+bool CC1101Sim::setSpeed(uint32_t hz) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _speedHz = hz;
+    return true;
+}
+
+uint32_t CC1101Sim::speed() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _speedHz;
+}
+
+bool CC1101Sim::waitForGdo2(uint32_t timeoutMs, int cancelFd) {
+    uint32_t start = millis();
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_gdo2) return true;
+        }
+        uint32_t elapsed = millis() - start;
+        if (elapsed >= timeoutMs) return false;
+
+        struct pollfd pfd[2] = { { _gdoFd, POLLIN, 0 }, { cancelFd, POLLIN, 0 } };
+        int n = ::poll(pfd, cancelFd >= 0 ? 2 : 1, (int)(timeoutMs - elapsed));
+        if (n > 0 && (pfd[1].revents & POLLIN)) return false;
+        if (n > 0 && (pfd[0].revents & POLLIN)) {
+            uint64_t v;
+            (void)::read(_gdoFd, &v, sizeof(v));
+        }
+    }
+}
+
+void CC1101Sim::reset() {
+    std::memcpy(_regs, kResetRegs, sizeof(_regs));
+    std::memset(_paTable, 0, sizeof(_paTable));
+    _paTable[0] = 0xC6;
+    _marc      = MARC_IDLE;
+    _rxLen     = 0;
+    _rxPartial = 0;
+    _txLen     = 0;
+    _gdo2      = false;
+    _wor       = false;
+}
+
+// Finish a transmission whose airtime has elapsed.
+void CC1101Sim::settle(Clock::time_point now) {
+    if (_marc == MARC_TX && now >= _txEnd) _marc = offMode(0);
+}
+
+// MCSM1 RXOFF_MODE (shift 2) or TXOFF_MODE (shift 0) as the next MARCSTATE.
+// "Stay in TX" is treated as IDLE: the model never retransmits.
+uint8_t CC1101Sim::offMode(int shift) const {
+    switch ((_regs[0x17] >> shift) & 0x03) {
+        case 1:  return MARC_FSTXON;
+        case 3:  return MARC_RX;
+        default: return MARC_IDLE;
+    }
+}
+
+uint8_t CC1101Sim::statusByte(bool read) const {
+    uint8_t state;
+    switch (_marc) {
+        case MARC_RX:     state = 1; break;
+        case MARC_TX:     state = 2; break;
+        case MARC_FSTXON: state = 3; break;
+        case MARC_RX_OVF: state = 6; break;
+        case MARC_TX_UNF: state = 7; break;
+        default:          state = 0; break;
+    }
+    size_t avail = read ? _rxLen : kFifoSize - 1 - std::min(_txLen, kFifoSize - 1);
+    // Bit 7 (CHIP_RDYn) is always 0: the crystal is always running.
+    return uint8_t(state << 4) | uint8_t(std::min<size_t>(avail, 15));
+}
+
+uint8_t CC1101Sim::readStatus(uint8_t addr) {
+    switch (addr) {
+        case 0x30: return 0x00;                       // PARTNUM
+        case 0x31: return 0x14;                       // VERSION
+        case 0x32: return _lastFreqEst;               // FREQEST
+        case 0x33: return _lastLqi;                   // LQI
+        case 0x34: return _lastRssi;                  // RSSI
+        case 0x35: return _marc;                      // MARCSTATE
+        case 0x38: return 0x80 | (_gdo2 ? 0x04 : 0);  // PKTSTATUS
+        case 0x3A: return uint8_t(_txLen | (_marc == MARC_TX_UNF ? 0x80 : 0)); // TXBYTES
+        case 0x3B: return uint8_t(_rxLen | (_marc == MARC_RX_OVF ? 0x80 : 0)); // RXBYTES
+        default:   return 0x00;
+    }
+}
+
+uint8_t CC1101Sim::popRx() {
+    _gdo2 = false;
+    if (_rxLen == 0) return 0;
+    uint8_t v = _rxFifo[0];
+    std::memmove(_rxFifo, _rxFifo + 1, --_rxLen);
+    _rxPartial = (_rxPartial + 1) % kFrameLen;
+    return v;
+}
+
+void CC1101Sim::strobe(uint8_t cmd, Clock::time_point now) {
+    switch (cmd) {
+        case 0x30: // SRES
+            reset();
+            break;
+        case 0x31: // SFSTXON
+            if (_marc == MARC_IDLE) _marc = MARC_FSTXON;
+            break;
+        case 0x34: // SRX
+            if (_marc == MARC_IDLE || _marc == MARC_FSTXON || _marc == MARC_TX) _marc = MARC_RX;
+            break;
+        case 0x35: // STX
+            if (_marc == MARC_IDLE || _marc == MARC_FSTXON || _marc == MARC_RX) transmit(now);
+            break;
+        case 0x36: // SIDLE
+            _marc = MARC_IDLE;
+            _wor  = false;
+            break;
+        case 0x38: // SWOR
+            if (_marc == MARC_IDLE) {
+                _marc     = MARC_SLEEP;
+                _wor      = true;
+                _worStart = now;
+            }
+            break;
+        case 0x3A: // SFRX
+            if (_marc == MARC_IDLE || _marc == MARC_RX_OVF) {
+                _rxLen     = 0;
+                _rxPartial = 0;
+                _gdo2      = false;
+                _marc      = MARC_IDLE;
+            }
+            break;
+        case 0x3B: // SFTX
+            if (_marc == MARC_IDLE || _marc == MARC_TX_UNF) {
+                _txLen = 0;
+                _marc  = MARC_IDLE;
+            }
+            break;
+        default:   // SXOFF, SCAL, SPWD, SWORRST, SNOP: no modelled effect
+            break;
+    }
+}
+
+// Send the TX FIFO. Command packets addressed to a simulated heater are
+// applied once per sequence number, as the remote repeats each one.
+void CC1101Sim::transmit(Clock::time_point now) {
+    if (_txLen == 0) {
+        _marc = MARC_TX_UNF;
+        return;
+    }
+
+    const uint8_t *p = _txFifo;
+    if (_txLen >= 9 && p[0] >= 8 && tunedCatches(now, nullptr) &&
+        crc16::compute(p, 7) == ((uint16_t(p[7]) << 8) | p[8])) {
+        uint32_t addr = (uint32_t(p[2]) << 24) | (uint32_t(p[3]) << 16) | (uint32_t(p[4]) << 8) | p[5];
+        for (Heater &h : _heaters) {
+            if (h.addr != addr || h.lastSeq == p[6]) continue;
+            h.lastSeq = p[6];
+            applyCommand(h, p[1], now);
+        }
+    }
+
+    _marc  = MARC_TX;
+    _txEnd = now + airtime(_txLen);
+    _txLen = 0;
+    _cv.notify_all(); // A heater may now answer early
+}
+
+void CC1101Sim::applyCommand(Heater &h, uint8_t cmd, Clock::time_point now) {
+    step(h, now);
+    bool on = h.state >= HEATER_STATE_STARTUP && h.state <= HEATER_STATE_RUNNING;
+    switch (cmd) {
+        case HEATER_CMD_POWER:
+            if (on) {
+                h.state    = HEATER_STATE_SHUTTING_DOWN;
+                h.phaseEnd = now + std::chrono::seconds(5);
+            } else if (h.state == HEATER_STATE_OFF) {
+                h.state    = HEATER_STATE_STARTUP;
+                h.phaseEnd = now + std::chrono::seconds(5);
+            }
+            break;
+        case HEATER_CMD_MODE:
+            h.autoMode = !h.autoMode;
+            break;
+        case HEATER_CMD_UP:
+            if (h.autoMode) h.setpoint = (int8_t)std::min(h.setpoint + 1, HEATER_SETPOINT_MAX);
+            else h.pumpFreq = std::min(h.pumpFreq + 0.1f, HEATER_PUMP_FREQ_MAX);
+            break;
+        case HEATER_CMD_DOWN:
+            if (h.autoMode) h.setpoint = (int8_t)std::max(h.setpoint - 1, HEATER_SETPOINT_MIN);
+            else h.pumpFreq = std::max(h.pumpFreq - 0.1f, HEATER_PUMP_FREQ_MIN);
+            break;
+        default: // HEATER_CMD_WAKEUP: just answer
+            break;
+    }
+    _commands.fetch_add(1, std::memory_order_relaxed);
+    h.nextTx = now + airtime(10) + std::chrono::milliseconds(50);
+}
+
+// Advance one heater's state machine and temperatures to now.
+void CC1101Sim::step(Heater &h, Clock::time_point now) {
+    while (now >= h.phaseEnd) {
+        Clock::time_point t = h.phaseEnd;
+        switch (h.state) {
+            case HEATER_STATE_STARTUP:
+                h.state    = HEATER_STATE_WARMING;
+                h.phaseEnd = t + std::chrono::seconds(20);
+                break;
+            case HEATER_STATE_WARMING:
+                h.state    = HEATER_STATE_RUNNING;
+                h.phaseEnd = Clock::time_point::max();
+                break;
+            case HEATER_STATE_SHUTTING_DOWN:
+                h.state    = HEATER_STATE_COOLING;
+                h.phaseEnd = t + std::chrono::seconds(30);
+                break;
+            default:
+                h.state    = HEATER_STATE_OFF;
+                h.phaseEnd = Clock::time_point::max();
+                break;
+        }
+    }
+
+    double dt = std::chrono::duration<double>(now - h.lastUpdate).count();
+    h.lastUpdate = now;
+
+    bool burning = h.state >= HEATER_STATE_WARMING && h.state <= HEATER_STATE_RUNNING;
+    if (burning && h.autoMode)
+        h.pumpFreq = std::min(5.5f, std::max(1.0f, 1.0f + (h.setpoint - h.ambient) * 0.5f));
+    float caseTarget = burning ? 80.0f + h.pumpFreq * 20.0f : h.ambient;
+    float roomTarget = burning ? h.setpoint + 1.0f : 10.0f;
+    h.caseTemp += (caseTarget - h.caseTemp) * (float)std::min(1.0, dt / 60.0);
+    h.ambient  += (roomTarget - h.ambient) * (float)std::min(1.0, dt / (burning ? 600.0 : 1800.0));
+}
+
+// One status packet from h, as the CC1101 would append it to the RX FIFO.
+void CC1101Sim::broadcast(Heater &h, Clock::time_point now) {
+    h.nextTx = now + period();
+    step(h, now);
+
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+    _sent.fetch_add(1, std::memory_order_relaxed);
+    if (chance(_rng) < _config.dropRate) {
+        _missed.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    bool burning = h.state >= HEATER_STATE_WARMING && h.state <= HEATER_STATE_RUNNING;
+    std::normal_distribution<float> volts(12.4f, 0.05f);
+    std::uniform_int_distribution<int> jitter(-_config.rssiJitterDb, _config.rssiJitterDb);
+
+    uint8_t f[kFrameLen] = {};
+    f[0]  = 21; // Length, excluding self
+    f[2]  = uint8_t(h.addr >> 24);
+    f[3]  = uint8_t(h.addr >> 16);
+    f[4]  = uint8_t(h.addr >> 8);
+    f[5]  = uint8_t(h.addr);
+    f[6]  = h.state;
+    f[7]  = burning ? uint8_t(std::lround(h.pumpFreq)) : 0;
+    f[9]  = uint8_t(std::lround(volts(_rng) * 10.0f));
+    f[10] = uint8_t(int8_t(std::lround(h.ambient)));
+    f[12] = uint8_t(std::lround(h.caseTemp));
+    f[13] = uint8_t(h.setpoint);
+    f[14] = h.autoMode ? 0x32 : 0xCD;
+    f[15] = uint8_t(std::lround(h.pumpFreq * 10.0f));
+    uint16_t crc = crc16::compute(f, 19);
+    f[19] = uint8_t(crc >> 8);
+    f[20] = uint8_t(crc);
+    f[22] = uint8_t(int8_t((_config.rssiDbm + jitter(_rng) + 74) * 2)); // RSSI
+    f[23] = 0x80 | 0x0C;                                                 // CRC_OK | LQI
+
+    if (chance(_rng) < _config.corruptRate) {
+        // Bit error the radio's own CRC missed; the application CRC catches it.
+        std::uniform_int_distribution<int> bit(8, 20 * 8 + 7);
+        int b = bit(_rng);
+        f[b / 8] ^= uint8_t(1 << (b % 8));
+        _corrupted.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    settle(now);
+    if (_wor) {
+        if (!worCatches(now)) {
+            _missed.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        _wor  = false;
+        _marc = MARC_RX; // Woke on this packet
+    }
+    if (_marc != MARC_RX) {
+        _missed.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    uint8_t freqEst = 0;
+    if (!tunedCatches(now, &freqEst)) {
+        _missed.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    if (_rxLen + kFrameLen > kFifoSize) {
+        _marc = MARC_RX_OVF;
+        _missed.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    std::memcpy(_rxFifo + _rxLen, f, kFrameLen);
+    _rxLen   += kFrameLen;
+    _lastRssi = f[22];
+    _lastLqi  = f[23];
+    _lastFreqEst = freqEst;
+    if (_rxPartial == 0) raiseGdo2();
+    _marc = offMode(2);
+}
+
+void CC1101Sim::raiseGdo2() {
+    if (_gdo2) return;
+    _gdo2 = true;
+    uint64_t one = 1;
+    (void)::write(_gdoFd, &one, sizeof(one));
+}
+
+// Whether a packet between a heater and a chip tuned by FSCTRL0 gets
+// through. freqEst (optional) receives what FREQEST would read: the residual
+// offset in fXOSC / 2^14 steps, give or take one.
+bool CC1101Sim::tunedCatches(Clock::time_point now, uint8_t *freqEst) {
+    static constexpr double kStepKhz = 26e3 / 16384.0;
+    double minutes  = std::chrono::duration<double>(now - _start).count() / 60.0;
+    double offset   = _config.freqOffsetKhz + _config.freqDriftKhzPerMin * minutes;
+    double residual = offset - int8_t(_regs[0x0C]) * kStepKhz;
+
+    if (freqEst) {
+        std::uniform_int_distribution<int> noise(-1, 1);
+        long est = std::lround(residual / kStepKhz) + noise(_rng);
+        *freqEst = uint8_t(int8_t(std::max(-128L, std::min(127L, est))));
+    }
+    double foc = channelBwKhz() / 4, edge = channelBwKhz() / 2, r = std::fabs(residual);
+    if (r <= foc) return true;
+    if (r >= edge) return false;
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+    return chance(_rng) >= (r - foc) / (edge - foc);
+}
+
+// Whether the WOR duty cycle catches a packet starting at start: an RX window
+// is open when the preamble begins, or the next one opens before the sync
+// word (4 preamble + 4 sync bytes) has been sent.
+bool CC1101Sim::worCatches(Clock::time_point start) const {
+    // RX timeout as a fraction of EVENT0 for WOR_RES = 0 (MCSM2 RX_TIME)
+    static const double kRxFraction[8] = {
+        0.036058, 0.018029, 0.009014, 0.004507, 0.002254, 0.001127, 0.000563, 1.0,
+    };
+    double event0 = double((_regs[0x1E] << 8) | _regs[0x1F]) * 750.0 / 26e6
+                  * std::ldexp(1.0, 5 * (_regs[0x20] & 0x03));
+    if (event0 <= 0) return true;
+    double window = event0 * kRxFraction[_regs[0x16] & 0x07];
+    double sync   = 8 * 8 / baud();
+    double phase  = std::fmod(std::chrono::duration<double>(start - _worStart).count(), event0);
+    return phase <= window || event0 - phase <= sync;
+}
+
+// Data rate programmed in MDMCFG4/MDMCFG3, in baud.
+double CC1101Sim::baud() const {
+    return (256.0 + _regs[0x11]) * std::ldexp(1.0, _regs[0x10] & 0x0F) * 26e6 / std::ldexp(1.0, 28);
+}
+
+// RX filter bandwidth programmed in MDMCFG4 (CHANBW_E, CHANBW_M), in kHz.
+double CC1101Sim::channelBwKhz() const {
+    int e = _regs[0x10] >> 6, m = (_regs[0x10] >> 4) & 0x03;
+    return 26e3 / (8.0 * (4 + m) * std::ldexp(1.0, e));
+}
+
+// Approximate on-air time: 4 preamble + 4 sync bytes, payload, 2 CRC bytes.
+CC1101Sim::Clock::duration CC1101Sim::airtime(size_t bytes) const {
+    double secs = (bytes + 10) * 8 / baud();
+    return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(secs));
+}
+
+// Time to a heater's next broadcast, with +/-10 % jitter.
+CC1101Sim::Clock::duration CC1101Sim::period() {
+    if (_config.rateHz <= 0) return std::chrono::hours(1);
+    std::uniform_real_distribution<double> jitter(0.9, 1.1);
+    return std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(jitter(_rng) / _config.rateHz));
+}
+
+void CC1101Sim::airLoop() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (!_stop) {
+        Clock::time_point due = Clock::time_point::max();
+        for (const Heater &h : _heaters) due = std::min(due, h.nextTx);
+        if (due == Clock::time_point::max())
+            _cv.wait(lock);
+        else
+            _cv.wait_until(lock, due);
+        if (_stop) break;
+
+        Clock::time_point now = Clock::now();
+        for (Heater &h : _heaters)
+            if (h.nextTx <= now) broadcast(h, now);
+    }
+}
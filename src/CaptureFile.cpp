@@ -0,0 +1,151 @@
+/*
+ * CaptureFile.cpp
+ *
+ * Packet capture writer and memory-mapped reader.
+ */
+
+#include "CaptureFile.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static constexpr char     kMagic[6]   = { 'D', 'H', 'C', 'A', 'P', 0 };
+static constexpr uint16_t kVersion    = 2;
+static constexpr size_t   kHeaderSize = 16;
+
+static void make_header(uint8_t *h) {
+    std::memset(h, 0, kHeaderSize);
+    std::memcpy(h, kMagic, sizeof(kMagic));
+    h[6] = uint8_t(kVersion);
+    h[7] = uint8_t(kVersion >> 8);
+    h[8] = uint8_t(sizeof(CaptureRecord));
+    h[9] = uint8_t(sizeof(CaptureRecord) >> 8);
+}
+
+static bool fail(std::string *error, const std::string &what) {
+    if (error) *error = what;
+    return false;
+}
+
+CaptureWriter::~CaptureWriter() {
+    close();
+}
+
+bool CaptureWriter::open(const std::string &path, std::string *error) {
+    close();
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) return fail(error, path + ": " + std::strerror(errno));
+
+    struct stat st;
+    if (::fstat(fd, &st) < 0) {
+        ::close(fd);
+        return fail(error, path + ": " + std::strerror(errno));
+    }
+
+    uint8_t header[kHeaderSize];
+    make_header(header);
+    if (st.st_size == 0) {
+        if (::write(fd, header, sizeof(header)) != (ssize_t)sizeof(header)) {
+            ::close(fd);
+            return fail(error, path + ": cannot write header");
+        }
+    } else {
+        // Appending to an existing capture: it must be one of ours
+        uint8_t existing[kHeaderSize];
+        int rfd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        bool ok = rfd >= 0 && ::read(rfd, existing, sizeof(existing)) == (ssize_t)sizeof(existing)
+               && std::memcmp(existing, header, 10) == 0;
+        if (rfd >= 0) ::close(rfd);
+        if (!ok) {
+            ::close(fd);
+            return fail(error, path + ": not a version 2 capture file");
+        }
+        // Drop a record torn by a crash so appends stay aligned
+        off_t tail = (st.st_size - (off_t)kHeaderSize) % (off_t)sizeof(CaptureRecord);
+        if (tail != 0 && ::ftruncate(fd, st.st_size - tail) < 0) {
+            ::close(fd);
+            return fail(error, path + ": " + std::strerror(errno));
+        }
+    }
+    _fd = fd;
+    return true;
+}
+
+void CaptureWriter::close() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_fd >= 0) ::close(_fd);
+    _fd = -1;
+}
+
+void CaptureWriter::append(uint64_t timestampUs, const char *data) {
+    CaptureRecord r;
+    r.timestampUs = timestampUs;
+    std::memcpy(r.data, data, sizeof(r.data));
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_fd < 0) return;
+    if (::write(_fd, &r, sizeof(r)) == (ssize_t)sizeof(r))
+        _records.fetch_add(1, std::memory_order_relaxed);
+}
+
+void CaptureWriter::appendDrain(uint64_t throughUs) {
+    CaptureRecord r = {};
+    r.timestampUs = CaptureRecord::kDrain | throughUs;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_fd < 0) return;
+    (void)!::write(_fd, &r, sizeof(r));
+}
+
+CaptureReader::~CaptureReader() {
+    close();
+}
+
+bool CaptureReader::open(const std::string &path, std::string *error) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return fail(error, path + ": " + std::strerror(errno));
+
+    struct stat st;
+    if (::fstat(fd, &st) < 0 || (size_t)st.st_size < kHeaderSize) {
+        ::close(fd);
+        return fail(error, path + ": not a capture file");
+    }
+    _len = (size_t)st.st_size;
+    _map = ::mmap(nullptr, _len, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (_map == MAP_FAILED) {
+        _map = nullptr;
+        return fail(error, path + ": mmap: " + std::strerror(errno));
+    }
+
+    // Version 1 files are read as well; they just have no drain records
+    uint8_t header[kHeaderSize];
+    make_header(header);
+    const uint8_t *h = static_cast<const uint8_t *>(_map);
+    uint16_t version = uint16_t(h[6] | (h[7] << 8));
+    if (std::memcmp(h, header, 6) != 0 || std::memcmp(h + 8, header + 8, 2) != 0 ||
+        version < 1 || version > kVersion) {
+        close();
+        return fail(error, path + ": not a capture file (version 1 or 2)");
+    }
+    _version = version;
+    ::madvise(_map, _len, MADV_SEQUENTIAL);
+
+    _records = reinterpret_cast<const CaptureRecord *>(static_cast<const uint8_t *>(_map) + kHeaderSize);
+    _count   = (_len - kHeaderSize) / sizeof(CaptureRecord); // A torn last record is ignored
+    return true;
+}
+
+void CaptureReader::close() {
+    if (_map) ::munmap(_map, _len);
+    _map     = nullptr;
+    _len     = 0;
+    _records = nullptr;
+    _count   = 0;
+    _version = 0;
+}
@@ -8,6 +8,80 @@
  */
 
 #include "DieselHeaterRF.h"
+#include "CaptureFile.h"
+#include "Metrics.h"
+#include "PiTransport.h"
+#include "crc16_modbus.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+// MARCSTATE (0x35) values
+static constexpr uint8_t MARCSTATE_IDLE = 0x01;
+static constexpr uint8_t MARCSTATE_RX   = 0x0D;
+
+// Bounds for confirming state transitions. Real transitions take
+// microseconds (IDLE) to about a millisecond (RX, with auto-calibration).
+static constexpr uint32_t IDLE_TIMEOUT_US  = 2000;
+static constexpr uint32_t RX_TIMEOUT_US    = 5000;
+static constexpr uint32_t RESET_TIMEOUT_US = 10000;
+static constexpr uint32_t TX_TIMEOUT_US    = 100000; // 10-byte packet airtime is ~16 ms
+static constexpr uint32_t TX_POLL_US       = 250;
+
+static uint64_t wallClockUs() {
+  return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// Radio metrics, registered on first use (see Metrics.h).
+struct RadioMetrics {
+  Counter   &spiTransactions;
+  Histogram &gdo2Wait;
+  Counter   &rxPackets;
+  Counter   &rxWrongLength;
+  Counter   &rxCrcErrors;
+  Counter   &rxOverflows;
+  Counter   &commands;
+  Histogram &commandDuration;
+  Counter   &commandsAcked;
+  Counter   &commandsUnacked;
+  Counter   &txFailures;
+  Histogram &commandAckDuration;
+  Counter   &stateTimeouts;
+  Gauge     &freqOffset;
+  Counter   &freqOffsetWrites;
+};
+
+static RadioMetrics &radioMetrics() {
+  static RadioMetrics m{
+    metrics().counter("cc1101_spi_transactions_total", "CS-framed SPI transactions with the CC1101"),
+    metrics().histogram("cc1101_gdo2_wait_seconds", "Time blocked waiting for GDO2 (packet received)"),
+    metrics().counter("cc1101_rx_packets_total", "Received packets with a valid CRC"),
+    metrics().counter("cc1101_rx_wrong_length_total", "RX FIFO contents flushed for not holding exactly one packet"),
+    metrics().counter("cc1101_rx_crc_errors_total", "Received packets failing the CRC check"),
+    metrics().counter("cc1101_rx_overflows_total", "RX FIFO overflows"),
+    metrics().counter("heater_commands_total", "Commands sent (each transmitted HEATER_TX_REPEAT times)"),
+    metrics().histogram("heater_command_duration_seconds", "Time to transmit all repeats of one command"),
+    metrics().counter("heater_commands_acked_total", "Acknowledged sends confirmed by a heater status packet"),
+    metrics().counter("heater_commands_unacked_total", "Acknowledged sends that never saw the expected change"),
+    metrics().counter("cc1101_tx_failures_total", "Command packets that never finished transmitting"),
+    metrics().histogram("heater_command_ack_seconds", "Duration of acknowledged sends, bursts and listening"),
+    metrics().counter("cc1101_state_timeouts_total", "MARCSTATE transitions not confirmed within their timeout"),
+    metrics().gauge("cc1101_freq_offset_steps", "FSCTRL0 frequency correction applied, in fXOSC/2^14 steps"),
+    metrics().counter("cc1101_freq_offset_writes_total", "FSCTRL0 rewrites by frequency offset tracking"),
+  };
+  return m;
+}
+
+// GDO2 wait, timed.
+static bool waitForPacket(CC1101Transport &transport, uint32_t timeout, int cancelFd) {
+  ScopedTimer t(radioMetrics().gdo2Wait);
+  return transport.waitForGdo2(timeout, cancelFd);
+}
 
 void DieselHeaterRF::begin() {
   begin(0);
@@ -16,18 +90,17 @@ void DieselHeaterRF::begin() {
 void DieselHeaterRF::begin(uint32_t heaterAddr) {
 
   _heaterAddr = heaterAddr;
+  radioMetrics(); // Register so every series is exported from the start
 
-  pinModePi(_pinSck,  PI_OUTPUT);
-  pinModePi(_pinMosi, PI_OUTPUT);
-  pinModePi(_pinMiso, PI_INPUT);
-  pinModePi(_pinSs,   PI_OUTPUT);
-  pinModePi(_pinGdo2, PI_INPUT);
-
-  // No SPI.begin on Pi; pi_spi.h sets up /dev/spidev0.0 globally.
-
-  delay(100);
+  // Without an explicit transport, drive the chip on the Pi's pins.
+  if (!_transport) {
+    _ownedTransport.reset(new PiTransport(HEATER_SPI_DEVICE, HEATER_SPI_SPEED_HZ,
+                                          _pinSck, _pinMiso, _pinMosi, _pinSs, _pinGdo2));
+    _transport = _ownedTransport.get();
+  }
+  _transport->begin();
 
-  initRadio();
+  if (_coldStart || !warmStart()) initRadio();
 
 }
 
@@ -53,15 +126,17 @@ bool DieselHeaterRF::getState(uint8_t *state, uint8_t *power, float *voltage, in
 
     if (address != _heaterAddr) return false;
 
-    *state = buf[6];
-    *power = buf[7];
-    *voltage = buf[9] / 10.0f;
-    *ambientTemp = buf[10];
-    *caseTemp = buf[12];
-    *setpoint = buf[13];
-    *autoMode = buf[14] == 0x32; // 0x32 = auto (thermostat), 0xCD = manual (Hertz mode) 
-    *pumpFreq = buf[15] / 10.0f;
-    *rssi = (buf[22] - (buf[22] >= 128 ? 256 : 0)) / 2 - 74;
+    heater_state_t st;
+    decodeState(buf, &st);
+    *state = st.state;
+    *power = st.power;
+    *voltage = st.voltage;
+    *ambientTemp = st.ambientTemp;
+    *caseTemp = st.caseTemp;
+    *setpoint = st.setpoint;
+    *autoMode = st.autoMode;
+    *pumpFreq = st.pumpFreq;
+    *rssi = st.rssi;
     return true;
   }
 
@@ -69,6 +144,20 @@ bool DieselHeaterRF::getState(uint8_t *state, uint8_t *power, float *voltage, in
 
 }
 
+void DieselHeaterRF::decodeState(const char *buf, heater_state_t *state) {
+  // Bytes are read as uint8_t: char is unsigned on the Pi but signed on x86.
+  const uint8_t *b = reinterpret_cast<const uint8_t *>(buf);
+  state->state = b[6];
+  state->power = b[7];
+  state->voltage = b[9] / 10.0f;
+  state->ambientTemp = int8_t(b[10]);
+  state->caseTemp = b[12];
+  state->setpoint = int8_t(b[13]);
+  state->autoMode = b[14] == 0x32; // 0x32 = auto (thermostat), 0xCD = manual (Hertz mode) 
+  state->pumpFreq = b[15] / 10.0f;
+  state->rssi = (b[22] - (b[22] >= 128 ? 256 : 0)) / 2 - 74;
+}
+
 void DieselHeaterRF::sendCommand(uint8_t cmd) {
   if (_heaterAddr == 0x00) return;
   sendCommand(cmd, _heaterAddr, HEATER_TX_REPEAT);
@@ -80,8 +169,117 @@ void DieselHeaterRF::sendCommand(uint8_t cmd, uint32_t addr) {
 
 void DieselHeaterRF::sendCommand(uint8_t cmd, uint32_t addr, uint8_t numTransmits) {
 
-  unsigned long t;
   char buf[10];
+  buildCommand(cmd, addr, buf);
+
+  radioMetrics().commands.inc();
+  ScopedTimer timer(radioMetrics().commandDuration);
+
+  for (int i = 0; i < numTransmits; i++) {
+    if (!transmitPacket(buf)) return;
+  }
+
+}
+
+bool DieselHeaterRF::sendCommandAcked(uint8_t cmd, uint32_t addr,
+                                      const std::function<bool(const heater_state_t &)> &acked,
+                                      heater_ack_t *result,
+                                      uint8_t burstLen, uint8_t maxFrames, uint16_t listenMs) {
+
+  // Every repeat, across all bursts, carries the same sequence number: the
+  // heater sees one command however many copies reach it.
+  char buf[10];
+  buildCommand(cmd, addr, buf);
+
+  radioMetrics().commands.inc();
+  ScopedTimer timer(radioMetrics().commandAckDuration);
+
+  *result = heater_ack_t();
+  uint32_t start = millis();
+  if (burstLen == 0) burstLen = 1;
+
+  while (result->frames < maxFrames && !result->delivered) {
+    result->bursts++;
+    for (uint8_t i = 0; i < burstLen && result->frames < maxFrames; i++) {
+      if (!transmitPacket(buf)) {
+        result->txFailed = true;
+        break;
+      }
+      result->frames++;
+    }
+    if (result->txFailed) break; // No point listening for an ack
+
+    uint32_t listenStart = millis();
+    heater_state_t st;
+    while (millis() - listenStart < listenMs) {
+      if (!listenForState(addr, &st, listenMs - (millis() - listenStart))) break;
+      result->heard = true;
+      result->state = st;
+      if (acked(st)) {
+        result->delivered = true;
+        break;
+      }
+    }
+    if (stopping()) break; // Radio worker shutting down
+  }
+
+  result->elapsedMs = millis() - start;
+  countAckOutcome(*result);
+  return result->delivered;
+
+}
+
+bool DieselHeaterRF::sendSteps(uint8_t cmd, uint8_t count, uint32_t addr,
+                               const std::function<bool(const heater_state_t &)> &reached,
+                               heater_ack_t *result, uint8_t burstLen, uint16_t listenMs) {
+
+  radioMetrics().commands.inc();
+  ScopedTimer timer(radioMetrics().commandAckDuration);
+
+  *result = heater_ack_t();
+  uint32_t start = millis();
+  if (burstLen == 0) burstLen = 1;
+
+  // No listening between steps: the whole sequence goes out in one go and
+  // only the final status is checked.
+  result->bursts = 1;
+  for (uint8_t step = 0; step < count && !result->txFailed && !stopping(); step++) {
+    char buf[10];
+    buildCommand(cmd, addr, buf);
+    for (uint8_t i = 0; i < burstLen; i++) {
+      if (!transmitPacket(buf)) {
+        result->txFailed = true;
+        break;
+      }
+      result->frames++;
+    }
+  }
+
+  uint32_t listenStart = millis();
+  heater_state_t st;
+  while (!result->txFailed && millis() - listenStart < listenMs) {
+    if (!listenForState(addr, &st, listenMs - (millis() - listenStart))) break;
+    result->heard = true;
+    result->state = st;
+    if (reached(st)) {
+      result->delivered = true;
+      break;
+    }
+  }
+
+  result->elapsedMs = millis() - start;
+  countAckOutcome(*result);
+  return result->delivered;
+
+}
+
+// A TX fault is counted by transmitPacket(), not as a missing ack.
+void DieselHeaterRF::countAckOutcome(const heater_ack_t &result) {
+  if (result.delivered) radioMetrics().commandsAcked.inc();
+  else if (!result.txFailed) radioMetrics().commandsUnacked.inc();
+}
+
+void DieselHeaterRF::buildCommand(uint8_t cmd, uint32_t addr, char *buf) {
 
   buf[0] = 9; // Packet length, excl. self
   buf[1] = cmd;
@@ -97,12 +295,38 @@ void DieselHeaterRF::sendCommand(uint8_t cmd, uint32_t addr, uint8_t numTransmit
   buf[7] = (crc >> 8) & 0xFF;
   buf[8] = crc & 0xFF;
 
-  for (int i = 0; i < numTransmits; i++) {
-    txBurst(10, buf);
-    t = millis();
-    while (readStatusReg(0x35) != 0x01) { delay(1); if (millis() - t > 100) { return; } } // Wait for idle state
+}
+
+// Send one 10-byte command packet and wait for the radio to return to IDLE.
+// If it never does, TX is forced back to IDLE and flushed before returning
+// false, so the next packet does not land on top of a stuck one.
+bool DieselHeaterRF::transmitPacket(char *buf) {
+
+  if (_freqTracking) applyFreqOffset(parseAddress(buf)); // Calibrated on the way to TX
+  txBurst(10, buf);
+  if (waitMarcState(MARCSTATE_IDLE, TX_TIMEOUT_US, TX_POLL_US)) return true; // TXOFF_MODE = IDLE: back in IDLE when sent
+  radioMetrics().txFailures.inc();
+  txFlush(); // SIDLE, SFTX
+  return false;
+
+}
+
+// Receive until a valid status packet from addr arrives or timeout elapses.
+bool DieselHeaterRF::listenForState(uint32_t addr, heater_state_t *state, uint32_t timeout) {
+
+  char buf[24];
+  uint32_t start = millis();
+
+  while (millis() - start < timeout) {
+    if (fdReadablePi(_cancelFd)) return false;
+    if (!receivePacket(buf, timeout - (millis() - start))) continue;
+    if (parseAddress(buf) != addr) continue;
+    decodeState(buf, state);
+    return true;
   }
 
+  return false;
+
 }
 
 uint32_t DieselHeaterRF::findAddress(uint16_t timeout) {
@@ -118,11 +342,11 @@ uint32_t DieselHeaterRF::findAddress(uint16_t timeout) {
 
 }
 
-uint32_t DieselHeaterRF::parseAddress(char *buf) {
+uint32_t DieselHeaterRF::parseAddress(const char *buf) {
   uint32_t address = 0;
-  address |= (uint32_t(buf[2]) << 24);
-  address |= (uint32_t(buf[3]) << 16);
-  address |= (uint32_t(buf[4]) << 8);
+  address |= (uint32_t(uint8_t(buf[2])) << 24);
+  address |= (uint32_t(uint8_t(buf[3])) << 16);
+  address |= (uint32_t(uint8_t(buf[4])) << 8);
   address |= uint8_t(buf[5]);
   return address;
 }
@@ -132,17 +356,19 @@ bool DieselHeaterRF::receivePacket(char *bytes, uint16_t timeout) {
   unsigned long t = millis();
   uint8_t rxLen;
 
+  if (_streaming) stopStreaming();
+
   rxFlush();
+  if (_freqTracking) applyFreqOffset(_heaterAddr);
   rxEnable();
 
   while (1) {
 
-    if (millis() - t > timeout) return false;
+    uint32_t elapsed = millis() - t;
+    if (elapsed > timeout) return false;
 
-    // Wait for GDO2 assertion
-    while (!digitalReadPi(_pinGdo2)) {
-      if (millis() - t > timeout) return false;
-    }
+    // Wait for GDO2 assertion (blocks on the edge event, no spinning)
+    if (!waitForPacket(*_transport, timeout - elapsed, _cancelFd)) return false;
 
     // Get number of bytes in RX FIFO
     rxLen = readStatusReg(0x3B); // RXBYTES
@@ -150,6 +376,7 @@ bool DieselHeaterRF::receivePacket(char *bytes, uint16_t timeout) {
     if (rxLen == 24) break;
 
     // Flush RX FIFO
+    radioMetrics().rxWrongLength.inc();
     rxFlush();
     rxEnable();
     
@@ -157,75 +384,361 @@ bool DieselHeaterRF::receivePacket(char *bytes, uint16_t timeout) {
 
   // Read RX FIFO
   rx(rxLen, bytes);
+  int8_t freqEst = readFreqEst();
   rxFlush();
+  if (_capture) _capture->append(wallClockUs(), bytes);
 
   uint16_t crc = crc16_2(bytes, 19);
-  if (crc == (uint16_t(bytes[19]) << 8) + uint8_t(bytes[20])) {
+  if (crc == (uint16_t(uint8_t(bytes[19])) << 8) + uint8_t(bytes[20])) {
+    radioMetrics().rxPackets.inc();
+    if (_freqTracking) trackFrequency(parseAddress(bytes), freqEst);
     return true;
   }
 
+  radioMetrics().rxCrcErrors.inc();
   return false;
   
 }
 
+void DieselHeaterRF::startStreaming() {
+  if (_freqTracking) applyFreqOffset(_heaterAddr);
+  if (_worEnabled) {
+    startWor();
+  } else {
+    writeConfigReg(0x17, 0x3C); // MCSM1: RXOFF_MODE = stay in RX
+    rxFlush();
+    rxEnable();
+  }
+  _streaming = true;
+}
+
+void DieselHeaterRF::stopStreaming() {
+  strobe(0x36); // SIDLE
+  if (_worActive) {
+    // Back to the initRadio() values
+    writeConfigReg(0x16, 0x07); // MCSM2
+    writeConfigReg(0x1E, 0x87); // WOREVT1
+    writeConfigReg(0x1F, 0x6B); // WOREVT0
+    writeConfigReg(0x20, 0xFB); // WORCTRL
+    _worActive = false;
+  }
+  writeConfigReg(0x17, 0x30); // MCSM1: RXOFF_MODE = IDLE
+  _streaming = false;
+}
+
+void DieselHeaterRF::setWakeOnRadio(bool enable, uint16_t periodMs, uint8_t rxTime) {
+  if (_streaming) stopStreaming();
+  _worEnabled  = enable;
+  _worPeriodMs = periodMs ? periodMs : 1;
+  _worRxTime   = rxTime & 0x07;
+}
+
+void DieselHeaterRF::startWor() {
+  // EVENT0 counts 750 / fXOSC (28.8 us at 26 MHz) with WOR_RES = 0; the
+  // longest period is about 1.9 s.
+  uint32_t event0 = uint32_t(_worPeriodMs) * 26000 / 750;
+  if (event0 > 0xFFFF) event0 = 0xFFFF;
+
+  strobe(0x36); // SIDLE
+  waitMarcState(MARCSTATE_IDLE, IDLE_TIMEOUT_US);
+  writeConfigReg(0x17, 0x30);                      // MCSM1: IDLE after a packet, until re-armed
+  writeConfigReg(0x16, 0x18 | _worRxTime);         // MCSM2: RX_TIME_RSSI | RX_TIME_QUAL | RX_TIME
+  writeConfigReg(0x1E, uint8_t(event0 >> 8));      // WOREVT1
+  writeConfigReg(0x1F, uint8_t(event0));           // WOREVT0
+  writeConfigReg(0x20, 0x78);                      // WORCTRL: RC osc on, EVENT1 = 48 clk, RC_CAL, WOR_RES = 0
+  _worActive = true;
+  rearmWor();
+}
+
+// After a packet the chip idles; flush and put it back to sleep under the
+// WOR timer.
+void DieselHeaterRF::rearmWor() {
+  rxFlush();
+  strobe(0x3C); // SWORRST
+  strobe(0x38); // SWOR
+}
+
+void DieselHeaterRF::setFreqTracking(bool enable, uint8_t thresholdSteps) {
+  _freqTracking  = enable;
+  _freqThreshold = thresholdSteps ? thresholdSteps : 1;
+}
+
+bool DieselHeaterRF::freqOffset(uint32_t addr, float *steps) const {
+  std::lock_guard<std::mutex> lock(_freqMutex);
+  auto it = _freqOffsets.find(addr);
+  if (it == _freqOffsets.end()) return false;
+  *steps = it->second;
+  return true;
+}
+
+void DieselHeaterRF::setFreqOffset(uint32_t addr, float steps) {
+  std::lock_guard<std::mutex> lock(_freqMutex);
+  _freqOffsets[addr] = std::max(-128.0f, std::min(127.0f, steps));
+}
+
+// FREQEST: carrier offset of the last packet relative to the current tuning,
+// valid until the next sync word.
+int8_t DieselHeaterRF::readFreqEst() {
+  return _freqTracking ? int8_t(readStatusReg(0x32)) : 0;
+}
+
+// Fold one good packet's offset into the learned offset of its heater (the
+// first packet sets it, later ones are averaged in with weight 1/8), then
+// retune if that moved the target far enough.
+void DieselHeaterRF::trackFrequency(uint32_t addr, int8_t freqEst) {
+  float measured = float(int8_t(readConfigReg(0x0C)) + freqEst); // FSCTRL0, from the shadow
+  measured = std::max(-128.0f, std::min(127.0f, measured));
+  {
+    std::lock_guard<std::mutex> lock(_freqMutex);
+    auto it = _freqOffsets.find(addr);
+    if (it == _freqOffsets.end()) _freqOffsets[addr] = measured;
+    else it->second += (measured - it->second) / 8;
+  }
+  if (!applyFreqOffset(_heaterAddr)) return;
+
+  // The synthesizer only picks up FSCTRL0 when it calibrates on the way from
+  // IDLE to RX (MCSM0 FS_AUTOCAL), so continuous RX is restarted. Packets
+  // already in the FIFO stay there.
+  if (_streaming && !_worActive) {
+    strobe(0x36); // SIDLE
+    waitMarcState(MARCSTATE_IDLE, IDLE_TIMEOUT_US);
+    rxEnable();
+  }
+}
+
+// Point FSCTRL0 at the learned offset of addr or, if it has none (addr 0
+// when serving every heater), at the mean of all learned offsets. Returns
+// true if the register was rewritten.
+bool DieselHeaterRF::applyFreqOffset(uint32_t addr) {
+  float target = 0;
+  {
+    std::lock_guard<std::mutex> lock(_freqMutex);
+    if (_freqOffsets.empty()) return false;
+    auto it = _freqOffsets.find(addr);
+    if (it != _freqOffsets.end()) {
+      target = it->second;
+    } else {
+      for (const auto &o : _freqOffsets) target += o.second;
+      target /= float(_freqOffsets.size());
+    }
+  }
+  int next = int(std::lround(target));
+  if (std::abs(next - int8_t(readConfigReg(0x0C))) < _freqThreshold) return false;
+
+  writeConfigReg(0x0C, uint8_t(int8_t(next))); // FSCTRL0
+  _appliedFreqOffset.store(int8_t(next), std::memory_order_relaxed);
+  radioMetrics().freqOffset.set(next);
+  radioMetrics().freqOffsetWrites.inc();
+  return true;
+}
+
+bool DieselHeaterRF::receiveFrame(heater_frame_t *frame, uint32_t timeout) {
+
+  if (!_streaming) startStreaming();
+
+  // Wait for GDO2 assertion (blocks on the edge event, no spinning)
+  if (!waitForPacket(*_transport, timeout, _cancelFd)) return false;
+
+  uint8_t rxBytes = readStatusReg(0x3B); // RXBYTES
+
+  if ((rxBytes & 0x80) || (rxBytes & 0x7F) < 24) {
+    // RX FIFO overflow or a short packet: resynchronise
+    if (rxBytes & 0x80) radioMetrics().rxOverflows.inc();
+    else radioMetrics().rxWrongLength.inc();
+    if (_worActive) {
+      rearmWor();
+    } else {
+      rxFlush();
+      rxEnable();
+    }
+    return false;
+  }
+
+  // A second packet may already be queued behind this one; it stays in the
+  // FIFO and GDO2 asserts again for it. Under WOR the chip idles after each
+  // packet and must be put back to sleep, after any retune.
+  rx(24, frame->data);
+  int8_t freqEst = readFreqEst();
+  frame->timestampUs = wallClockUs();
+
+  uint16_t crc = crc16_2(frame->data, 19);
+  bool crcOk = crc == (uint16_t(uint8_t(frame->data[19])) << 8) + uint8_t(frame->data[20]);
+  if (crcOk && _freqTracking) trackFrequency(parseAddress(frame->data), freqEst);
+  if (_worActive) rearmWor();
+  if (_capture) _capture->append(frame->timestampUs, frame->data);
+
+  if (!crcOk) {
+    radioMetrics().rxCrcErrors.inc();
+    return false;
+  }
+  radioMetrics().rxPackets.inc();
+
+  uint8_t rssiRaw = uint8_t(frame->data[22]);
+  frame->rssi = (rssiRaw - (rssiRaw >= 128 ? 256 : 0)) / 2 - 74;
+  frame->lqi  = uint8_t(frame->data[23]) & 0x7F;
+  return true;
+
+}
+
+// Configuration registers 0x00-0x2E, written as one burst by initRadio().
+// Registers this application does not tune hold their reset values.
+static const uint8_t kRadioConfig[0x2F] = {
+  0x07, // 0x00 IOCFG2
+  0x2E, // 0x01 IOCFG1   (reset value)
+  0x06, // 0x02 IOCFG0
+  0x47, // 0x03 FIFOTHR
+  0x7E, // 0x04 SYNC1
+  0x3C, // 0x05 SYNC0
+  0xFF, // 0x06 PKTLEN   (reset value)
+  0x04, // 0x07 PKTCTRL1
+  0x05, // 0x08 PKTCTRL0
+  0x00, // 0x09 ADDR
+  0x00, // 0x0A CHANNR
+  0x06, // 0x0B FSCTRL1
+  0x00, // 0x0C FSCTRL0
+  0x10, // 0x0D FREQ2
+  0xB1, // 0x0E FREQ1
+  0x3B, // 0x0F FREQ0
+  0xF8, // 0x10 MDMCFG4
+  0x93, // 0x11 MDMCFG3
+  0x13, // 0x12 MDMCFG2
+  0x22, // 0x13 MDMCFG1
+  0xF8, // 0x14 MDMCFG0
+  0x26, // 0x15 DEVIATN
+  0x07, // 0x16 MCSM2    (reset value)
+  0x30, // 0x17 MCSM1
+  0x18, // 0x18 MCSM0
+  0x16, // 0x19 FOCCFG
+  0x6C, // 0x1A BSCFG
+  0x03, // 0x1B AGCTRL2
+  0x40, // 0x1C AGCTRL1
+  0x91, // 0x1D AGCTRL0
+  0x87, // 0x1E WOREVT1  (reset value)
+  0x6B, // 0x1F WOREVT0  (reset value)
+  0xFB, // 0x20 WORCTRL
+  0x56, // 0x21 FREND1
+  0x17, // 0x22 FREND0
+  0xE9, // 0x23 FSCAL3
+  0x2A, // 0x24 FSCAL2
+  0x00, // 0x25 FSCAL1
+  0x1F, // 0x26 FSCAL0
+  0x41, // 0x27 RCCTRL1  (reset value)
+  0x00, // 0x28 RCCTRL0  (reset value)
+  0x59, // 0x29 FSTEST   (reset value)
+  0x7F, // 0x2A PTEST    (reset value)
+  0x3F, // 0x2B AGCTEST  (reset value)
+  0x81, // 0x2C TEST2
+  0x35, // 0x2D TEST1
+  0x09, // 0x2E TEST0
+};
+
+static const uint8_t kPaTable[8] = {0x00, 0x12, 0x0E, 0x34, 0x60, 0xC5, 0xC1, 0xC0};
+
+// Bits of each register that must match kRadioConfig on a warm start. The
+// frequency synthesizer (FSCAL3-1) and RC oscillator (RCCTRL1-0) calibrations
+// overwrite their result bits, so only the settings bits are compared.
+static uint8_t warmCompareMask(uint8_t addr) {
+  switch (addr) {
+    case 0x23: return 0xF0; // FSCAL3: charge pump setting, CHP_CURR_CAL_EN
+    case 0x24: return 0x20; // FSCAL2: VCO_CORE_H_EN
+    case 0x25: return 0x00; // FSCAL1
+    case 0x27: return 0x00; // RCCTRL1
+    case 0x28: return 0x00; // RCCTRL0
+    default:   return 0xFF;
+  }
+}
+
+static bool shadowed(uint8_t addr) {
+  return addr < sizeof(kRadioConfig) && warmCompareMask(addr) == 0xFF;
+}
+
 void DieselHeaterRF::initRadio() {
 
+  _shadowValid   = false;
+  _startRewrites = -1;
   strobe(0x30); // SRES
+  waitMarcState(MARCSTATE_IDLE, RESET_TIMEOUT_US);
+
+  // One batch for the whole configuration: the 0x00-0x2E register block as
+  // a single burst, PATABLE, then the flush/idle strobes, each its own CS
+  // transaction.
+  PiSPIBatch batch;
+  queueWriteBurst(batch, 0x00, kRadioConfig, sizeof(kRadioConfig));
+  queueWriteBurst(batch, 0x3E, kPaTable, sizeof(kPaTable)); // PATABLE
+  queueStrobe(batch, 0x31); // SFSTXON
+  queueStrobe(batch, 0x36); // SIDLE
+  queueStrobe(batch, 0x3B); // SFTX
+  queueStrobe(batch, 0x36); // SIDLE
+  queueStrobe(batch, 0x3A); // SFRX
+  spiBatch(batch);
+  waitMarcState(MARCSTATE_IDLE, RESET_TIMEOUT_US);
+
+  std::memcpy(_shadow, kRadioConfig, sizeof(_shadow));
+  _shadowValid = true;
+  _appliedFreqOffset.store(0, std::memory_order_relaxed);
+  radioMetrics().freqOffset.set(0);
 
-  delay(100);
-
-  writeConfigReg(0x00, 0x07); // IOCFG2
-  writeConfigReg(0x02, 0x06); // IOCFG0
-  writeConfigReg(0x03, 0x47); // FIFOTHR
-  writeConfigReg(0x07, 0x04); // PKTCTRL1
-  writeConfigReg(0x08, 0x05); // PKTCTRL0
-  writeConfigReg(0x0A, 0x00); // CHANNR
-  writeConfigReg(0x0B, 0x06); // FSCTRL1
-  writeConfigReg(0x0C, 0x00); // FSCTRL0
-  writeConfigReg(0x0D, 0x10); // FREQ2
-  writeConfigReg(0x0E, 0xB1); // FREQ1
-  writeConfigReg(0x0F, 0x3B); // FREQ0
-  writeConfigReg(0x10, 0xF8); // MDMCFG4
-  writeConfigReg(0x11, 0x93); // MDMCFG3
-  writeConfigReg(0x12, 0x13); // MDMCFG2
-  writeConfigReg(0x13, 0x22); // MDMCFG1
-  writeConfigReg(0x14, 0xF8); // MDMCFG0
-  writeConfigReg(0x15, 0x26); // DEVIATN
-  writeConfigReg(0x17, 0x30); // MCSM1
-  writeConfigReg(0x18, 0x18); // MCSM0
-  writeConfigReg(0x19, 0x16); // FOCCFG
-  writeConfigReg(0x1A, 0x6C); // BSCFG
-  writeConfigReg(0x1B, 0x03); // AGCTRL2
-  writeConfigReg(0x1C, 0x40); // AGCTRL1
-  writeConfigReg(0x1D, 0x91); // AGCTRL0
-  writeConfigReg(0x20, 0xFB); // WORCTRL
-  writeConfigReg(0x21, 0x56); // FREND1
-  writeConfigReg(0x22, 0x17); // FREND0
-  writeConfigReg(0x23, 0xE9); // FSCAL3
-  writeConfigReg(0x24, 0x2A); // FSCAL2
-  writeConfigReg(0x25, 0x00); // FSCAL1
-  writeConfigReg(0x26, 0x1F); // FSCAL0
-  writeConfigReg(0x2C, 0x81); // TEST2
-  writeConfigReg(0x2D, 0x35); // TEST1
-  writeConfigReg(0x2E, 0x09); // TEST0
-  writeConfigReg(0x09, 0x00); // ADDR
-  writeConfigReg(0x04, 0x7E); // SYNC1
-  writeConfigReg(0x05, 0x3C); // SYNC0
-
-  static const uint8_t patable[8] = {0x00, 0x12, 0x0E, 0x34, 0x60, 0xC5, 0xC1, 0xC0};
-  writeBurstReg(0x3E, patable, 8); // PATABLE
-
-  strobe(0x31); // SFSTXON
-  strobe(0x36); // SIDLE
-  strobe(0x3B); // SFTX
+}
+
+// Reuse the configuration left by a previous run. The chip is taken out of
+// RX or WOR sleep, read back in one burst (plus PATABLE), and rewritten only
+// where it differs, typically MCSM1/MCSM2/WOR left behind by streaming.
+// Returns false, leaving the full reset to initRadio(), if the chip does not
+// answer or carries another frequency, sync word or data rate.
+bool DieselHeaterRF::warmStart() {
+
+  _shadowValid = false;
   strobe(0x36); // SIDLE
-  strobe(0x3A); // SFRX
+  if (!waitMarcState(MARCSTATE_IDLE, IDLE_TIMEOUT_US)) return false;
+
+  uint8_t regs[sizeof(kRadioConfig)];
+  uint8_t pa[sizeof(kPaTable)];
+  readBurstReg(0x00, regs, sizeof(regs));
+  readBurstReg(0x3E, pa, sizeof(pa)); // PATABLE
+
+  static const uint8_t kIdentity[] = {
+    0x04, 0x05,       // SYNC1, SYNC0
+    0x0D, 0x0E, 0x0F, // FREQ2, FREQ1, FREQ0
+    0x10, 0x11, 0x12, // MDMCFG4, MDMCFG3, MDMCFG2
+  };
+  for (uint8_t addr : kIdentity)
+    if (regs[addr] != kRadioConfig[addr]) return false;
+
+  // Each run of consecutive differing registers is one burst write.
+  PiSPIBatch batch;
+  int rewrites = 0;
+  for (uint8_t addr = 0; addr < sizeof(kRadioConfig); ) {
+    uint8_t end = addr;
+    while (end < sizeof(kRadioConfig) &&
+           ((regs[end] ^ kRadioConfig[end]) & warmCompareMask(end)) != 0)
+      end++;
+    if (end == addr) {
+      addr++;
+      continue;
+    }
+    queueWriteBurst(batch, addr, &kRadioConfig[addr], end - addr);
+    rewrites += end - addr;
+    addr = end;
+  }
+  if (std::memcmp(pa, kPaTable, sizeof(pa)) != 0)
+    queueWriteBurst(batch, 0x3E, kPaTable, sizeof(kPaTable));
+  queueStrobe(batch, 0x3B); // SFTX
+  queueStrobe(batch, 0x3A); // SFRX
+  spiBatch(batch);
 
-  delay(136);
+  // Only now has every rewrite reached the chip.
+
+  std::memcpy(_shadow, kRadioConfig, sizeof(_shadow));
+  _shadowValid   = true;
+  _startRewrites = rewrites;
+  _appliedFreqOffset.store(0, std::memory_order_relaxed);
+  radioMetrics().freqOffset.set(0);
+  return true;
 
 }
 
 void DieselHeaterRF::txBurst(uint8_t len, char *bytes) {
+    if (_streaming) stopStreaming();
     txFlush();
     writeBurstReg(0x3F, reinterpret_cast<const uint8_t *>(bytes), len); // TXFIFO burst write
     strobe(0x35); // STX
@@ -233,24 +746,36 @@ void DieselHeaterRF::txBurst(uint8_t len, char *bytes) {
 
 void DieselHeaterRF::txFlush() {
     strobe(0x36); // SIDLE
+    waitMarcState(MARCSTATE_IDLE, IDLE_TIMEOUT_US); // SFTX is only valid in IDLE
     strobe(0x3B); // SFTX
-    delay(16); // Prevent TX underflow when bursting immediately after flush
 }
 
 void DieselHeaterRF::rx(uint8_t len, char *bytes) {
-    for (int i = 0; i < (int)len; i++)
-        bytes[i] = static_cast<char>(readConfigReg(0x3F)); // RXFIFO single read
+    readBurstReg(0x3F, reinterpret_cast<uint8_t *>(bytes), len); // RXFIFO burst read
 }
 
 void DieselHeaterRF::rxFlush() {
     strobe(0x36); // SIDLE
+    waitMarcState(MARCSTATE_IDLE, IDLE_TIMEOUT_US); // SFRX is only valid in IDLE
     (void)readConfigReg(0x3F); // Dummy RXFIFO read to de-assert GDO2
     strobe(0x3A); // SFRX
-    delay(16);
 }
 
 void DieselHeaterRF::rxEnable() {
     strobe(0x34); // SRX
+    waitMarcState(MARCSTATE_RX, RX_TIMEOUT_US);
+}
+
+bool DieselHeaterRF::waitMarcState(uint8_t state, uint32_t timeoutUs, uint32_t pollUs) {
+    uint32_t start = micros();
+    while ((readStatusReg(0x35) & 0x1F) != state) {
+        if (micros() - start > timeoutUs) {
+            radioMetrics().stateTimeouts.inc();
+            return false;
+        }
+        if (pollUs) delayMicroseconds(pollUs);
+    }
+    return true;
 }
 
 // ---------------------------------------------------------------------------
@@ -258,19 +783,23 @@ void DieselHeaterRF::rxEnable() {
 // ---------------------------------------------------------------------------
 
 void DieselHeaterRF::spiTransaction(const uint8_t *tx, uint8_t *rx, size_t len) {
-    digitalWritePi(_pinSs, PI_LOW);
-    while (digitalReadPi(_pinMiso)) {} // Wait for CHIP_RDYn
-    g_spi.transfer_buf(tx, rx, len);
-    digitalWritePi(_pinSs, PI_HIGH);
+    radioMetrics().spiTransactions.inc();
+    _transport->transfer(tx, rx, len);
 }
 
 void DieselHeaterRF::writeConfigReg(uint8_t addr, uint8_t val) {
-    uint8_t tx[2] = { static_cast<uint8_t>(addr & 0x3F), val };
+    addr &= 0x3F;
+    if (_shadowValid && shadowed(addr)) {
+        if (_shadow[addr] == val) return; // Already set
+        _shadow[addr] = val;
+    }
+    uint8_t tx[2] = { addr, val };
     uint8_t rx[2];
     spiTransaction(tx, rx, 2);
 }
 
 uint8_t DieselHeaterRF::readConfigReg(uint8_t addr) {
+    if (_shadowValid && shadowed(addr & 0x3F)) return _shadow[addr & 0x3F];
     uint8_t tx[2] = { static_cast<uint8_t>(0x80 | (addr & 0x3F)), 0x00 };
     uint8_t rx[2] = {};
     spiTransaction(tx, rx, 2);
@@ -292,7 +821,7 @@ void DieselHeaterRF::strobe(uint8_t cmd) {
 }
 
 void DieselHeaterRF::writeBurstReg(uint8_t addr, const uint8_t *data, uint8_t len) {
-    // Max burst in this application: TXFIFO (10 bytes) or PATABLE (8 bytes).
+    // Max burst in this application: the 0x00-0x2E config block (47 bytes).
     uint8_t tx[64];
     uint8_t rx[64];
     tx[0] = 0x40 | (addr & 0x3F); // burst write header
@@ -301,23 +830,50 @@ void DieselHeaterRF::writeBurstReg(uint8_t addr, const uint8_t *data, uint8_t le
     spiTransaction(tx, rx, static_cast<size_t>(len) + 1);
 }
 
+void DieselHeaterRF::readBurstReg(uint8_t addr, uint8_t *data, uint8_t len) {
+    // 0xC0 | addr: burst read. For 0x3F (RXFIFO) this is the 0xFF header and
+    // drains len bytes of the FIFO in one transfer. Note that 0x30-0x3D with
+    // the burst bit select single status registers, not a burst.
+    uint8_t tx[65] = {};
+    uint8_t rx[65];
+    if (len > 64) len = 64;
+    tx[0] = 0xC0 | (addr & 0x3F); // burst read header
+    spiTransaction(tx, rx, static_cast<size_t>(len) + 1);
+    for (uint8_t i = 0; i < len; i++)
+        data[i] = rx[i + 1];
+}
+
+void DieselHeaterRF::queueStrobe(PiSPIBatch &batch, uint8_t cmd) {
+    queueOp(batch, &cmd, 1);
+}
+
+void DieselHeaterRF::queueWriteBurst(PiSPIBatch &batch, uint8_t addr, const uint8_t *data, uint8_t len) {
+    uint8_t tx[64];
+    if (len > 63) len = 63;
+    tx[0] = 0x40 | (addr & 0x3F); // burst write header
+    for (uint8_t i = 0; i < len; i++)
+        tx[i + 1] = data[i];
+    queueOp(batch, tx, static_cast<size_t>(len) + 1);
+}
+
+// A full batch is sent as it stands and the operation starts the next one,
+// so nothing queued is ever dropped.
+void DieselHeaterRF::queueOp(PiSPIBatch &batch, const uint8_t *tx, size_t len) {
+    if (batch.add(tx, len)) return;
+    spiBatch(batch);
+    batch.clear();
+    if (!batch.add(tx, len))
+        throw std::logic_error("CC1101 operation larger than an SPI batch");
+}
+
+void DieselHeaterRF::spiBatch(PiSPIBatch &batch) {
+    radioMetrics().spiTransactions.inc();
+    _transport->transferBatch(batch);
+}
+
 /*
- * CRC-16/MODBUS
+ * CRC-16/MODBUS (table-driven, see crc16_modbus.h)
  */
 uint16_t DieselHeaterRF::crc16_2(char *buf, int len) {
-
-  uint16_t crc = 0xFFFF;
-
-  for (int pos = 0; pos < len; pos++) {
-    crc ^= (uint8_t)buf[pos];
-    for (int i = 8; i != 0; i--) {
-      if ((crc & 0x0001) != 0) {
-        crc >>= 1;
-        crc ^= 0xA001;
-      } else {
-        crc >>= 1;
-      }
-    }
-  }
-  return crc;
+  return crc16::compute(reinterpret_cast<const uint8_t *>(buf), static_cast<size_t>(len));
 }
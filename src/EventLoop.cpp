@@ -0,0 +1,177 @@
+/*
+ * EventLoop.cpp
+ *
+ * epoll reactor with timerfd, signalfd and eventfd-based cross-thread posts.
+ */
+
+#include "EventLoop.h"
+#include "Metrics.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+static Histogram &dispatchDuration() {
+    static Histogram &h = metrics().histogram(
+        "event_loop_dispatch_seconds", "Time spent handling one event-loop wakeup");
+    return h;
+}
+
+static struct itimerspec timer_spec(uint32_t firstMs, uint32_t intervalMs) {
+    struct itimerspec its{};
+    its.it_value.tv_sec     = firstMs / 1000;
+    its.it_value.tv_nsec    = long(firstMs % 1000) * 1000000L;
+    its.it_interval.tv_sec  = intervalMs / 1000;
+    its.it_interval.tv_nsec = long(intervalMs % 1000) * 1000000L;
+    return its;
+}
+
+EventLoop::EventLoop() {
+    _epollFd = ::epoll_create1(EPOLL_CLOEXEC);
+    _wakeFd  = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (_epollFd < 0 || _wakeFd < 0)
+        throw std::runtime_error("epoll/eventfd failed");
+    add(_wakeFd, EPOLLIN, [this](uint32_t) {
+        uint64_t v;
+        while (::read(_wakeFd, &v, sizeof(v)) == sizeof(v)) {}
+        runPosted();
+    });
+    dispatchDuration();
+}
+
+EventLoop::~EventLoop() {
+    for (int fd : _owned) ::close(fd);
+    if (_wakeFd >= 0) ::close(_wakeFd);
+    if (_epollFd >= 0) ::close(_epollFd);
+}
+
+bool EventLoop::add(int fd, uint32_t events, Handler handler) {
+    struct epoll_event ev{};
+    ev.events  = events;
+    ev.data.fd = fd;
+    if (::epoll_ctl(_epollFd, EPOLL_CTL_ADD, fd, &ev) < 0) return false;
+    _handlers[fd] = std::make_shared<Handler>(std::move(handler));
+    return true;
+}
+
+bool EventLoop::modify(int fd, uint32_t events) {
+    struct epoll_event ev{};
+    ev.events  = events;
+    ev.data.fd = fd;
+    return ::epoll_ctl(_epollFd, EPOLL_CTL_MOD, fd, &ev) == 0;
+}
+
+void EventLoop::remove(int fd) {
+    ::epoll_ctl(_epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    _handlers.erase(fd);
+}
+
+int EventLoop::addTimer(uint32_t firstMs, uint32_t intervalMs, std::function<void()> fn) {
+    int fd = ::timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (fd < 0) return -1;
+    bool ok = add(fd, EPOLLIN, [fd, fn = std::move(fn)](uint32_t) {
+        uint64_t expirations;
+        if (::read(fd, &expirations, sizeof(expirations)) == sizeof(expirations)) fn();
+    });
+    if (!ok) {
+        ::close(fd);
+        return -1;
+    }
+    _owned.push_back(fd);
+    setTimer(fd, firstMs, intervalMs);
+    return fd;
+}
+
+void EventLoop::setTimer(int timer, uint32_t firstMs, uint32_t intervalMs) {
+    struct itimerspec its = timer_spec(firstMs, intervalMs);
+    ::timerfd_settime(timer, 0, &its, nullptr);
+}
+
+void EventLoop::removeTimer(int timer) {
+    remove(timer);
+    closeOwned(timer);
+}
+
+void EventLoop::blockSignals(std::initializer_list<int> sigs) {
+    sigset_t mask;
+    sigemptyset(&mask);
+    for (int s : sigs) sigaddset(&mask, s);
+    ::pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+}
+
+bool EventLoop::addSignals(std::initializer_list<int> sigs, std::function<void(int)> fn) {
+    sigset_t mask;
+    sigemptyset(&mask);
+    for (int s : sigs) sigaddset(&mask, s);
+    int fd = ::signalfd(-1, &mask, SFD_CLOEXEC | SFD_NONBLOCK);
+    if (fd < 0) return false;
+    bool ok = add(fd, EPOLLIN, [fd, fn = std::move(fn)](uint32_t) {
+        struct signalfd_siginfo si;
+        while (::read(fd, &si, sizeof(si)) == sizeof(si)) fn(int(si.ssi_signo));
+    });
+    if (!ok) {
+        ::close(fd);
+        return false;
+    }
+    _owned.push_back(fd);
+    return true;
+}
+
+void EventLoop::post(std::function<void()> fn) {
+    {
+        std::lock_guard<std::mutex> lock(_postMutex);
+        _posted.push_back(std::move(fn));
+    }
+    wake();
+}
+
+void EventLoop::wake() {
+    uint64_t one = 1;
+    (void)::write(_wakeFd, &one, sizeof(one));
+}
+
+void EventLoop::stop() {
+    post([this] { _stop = true; });
+}
+
+void EventLoop::runPosted() {
+    std::vector<std::function<void()>> posted;
+    {
+        std::lock_guard<std::mutex> lock(_postMutex);
+        posted.swap(_posted);
+    }
+    for (auto &fn : posted) fn();
+}
+
+void EventLoop::closeOwned(int fd) {
+    auto it = std::find(_owned.begin(), _owned.end(), fd);
+    if (it == _owned.end()) return;
+    _owned.erase(it);
+    ::close(fd);
+}
+
+void EventLoop::run() {
+    _stop = false;
+    struct epoll_event events[16];
+    while (!_stop) {
+        if (_idle) _idle();
+        int n = ::epoll_wait(_epollFd, events, 16, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error("epoll_wait failed");
+        }
+        ScopedTimer t(dispatchDuration());
+        for (int i = 0; i < n && !_stop; i++) {
+            auto it = _handlers.find(events[i].data.fd);
+            if (it == _handlers.end()) continue; // Removed by an earlier handler
+            std::shared_ptr<Handler> handler = it->second;
+            (*handler)(events[i].events);
+        }
+    }
+}
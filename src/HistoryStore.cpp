@@ -0,0 +1,342 @@
+/*
+ * HistoryStore.cpp
+ *
+ * Memory-mapped telemetry history with minute and hour rollups.
+ */
+
+#include "HistoryStore.h"
+
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static constexpr char     kMagic[8] = { 'D', 'H', 'H', 'I', 'S', 'T', 0, 0 };
+static constexpr uint32_t kVersion  = 1;
+
+struct HistoryStore::Header {
+    char     magic[8];
+    uint32_t version;
+    uint32_t rawCapacity, minuteCapacity, hourCapacity;
+    uint32_t rawHead, rawCount;       // head = next slot to write
+    uint32_t minuteHead, minuteCount;
+    uint32_t hourHead, hourCount;
+    uint32_t lastTime;                // Newest sample recorded
+    uint32_t reserved;
+    HistoryBucket minuteOpen, hourOpen; // Buckets still filling
+};
+
+// Display name and scale of each rollup metric
+static const char *const kMetricName[H_METRIC_COUNT] = {
+    "ambient_temp", "case_temp", "voltage", "pump_freq", "rssi",
+};
+static const double kMetricScale[H_METRIC_COUNT] = { 1, 1, 0.1, 0.1, 1 };
+
+// ---- Fixed-capacity rings over the mapping, oldest entry at index 0 ----
+
+template <typename T>
+static void ring_push(T *base, uint32_t cap, uint32_t &head, uint32_t &count, const T &v) {
+    base[head] = v;
+    head = (head + 1) % cap;
+    if (count < cap) count++;
+}
+
+template <typename T>
+static const T &ring_at(const T *base, uint32_t cap, uint32_t head, uint32_t count, uint32_t i) {
+    return base[(head + cap - count + i) % cap];
+}
+
+static uint32_t entry_time(const HistorySample &s) { return s.time; }
+static uint32_t entry_time(const HistoryBucket &b) { return b.start; }
+
+// Index of the first entry at or after time.
+template <typename T>
+static uint32_t ring_lower_bound(const T *base, uint32_t cap, uint32_t head, uint32_t count, uint32_t time) {
+    uint32_t lo = 0, hi = count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (entry_time(ring_at(base, cap, head, count, mid)) < time) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// ---- Buckets ----
+
+static void bucket_init(HistoryBucket &b, uint32_t start) {
+    std::memset(&b, 0, sizeof(b));
+    b.start = start;
+}
+
+static void sample_values(const HistorySample &s, int16_t v[H_METRIC_COUNT]) {
+    v[H_AMBIENT_TEMP] = s.ambientTemp;
+    v[H_CASE_TEMP]    = s.caseTemp;
+    v[H_VOLTAGE]      = s.voltage;
+    v[H_PUMP_FREQ]    = s.pumpFreq;
+    v[H_RSSI]         = s.rssi;
+}
+
+static void bucket_add(HistoryBucket &b, const HistorySample &s, bool on) {
+    int16_t v[H_METRIC_COUNT];
+    sample_values(s, v);
+    for (size_t m = 0; m < H_METRIC_COUNT; m++) {
+        HistoryStat &st = b.stat[m];
+        if (b.count == 0 || v[m] < st.min) st.min = v[m];
+        if (b.count == 0 || v[m] > st.max) st.max = v[m];
+        st.sum += v[m];
+    }
+    b.count++;
+    if (on) b.onCount++;
+}
+
+static void bucket_merge(HistoryBucket &into, const HistoryBucket &b) {
+    if (b.count == 0) return;
+    for (size_t m = 0; m < H_METRIC_COUNT; m++) {
+        HistoryStat &st = into.stat[m];
+        if (into.count == 0 || b.stat[m].min < st.min) st.min = b.stat[m].min;
+        if (into.count == 0 || b.stat[m].max > st.max) st.max = b.stat[m].max;
+        st.sum += b.stat[m].sum;
+    }
+    into.count   += b.count;
+    into.onCount += b.onCount;
+}
+
+// Close open if t falls in a later bucket, then start the bucket holding t.
+static void bucket_roll(HistoryBucket &open, uint32_t width, uint32_t t,
+                        HistoryBucket *ring, uint32_t cap, uint32_t &head, uint32_t &count) {
+    uint32_t start = t - t % width;
+    if (open.count > 0 && open.start == start) return;
+    if (open.count > 0) ring_push(ring, cap, head, count, open);
+    bucket_init(open, start);
+}
+
+// ---- JSON ----
+
+static void append_fmt(std::string &out, const char *fmt, double v) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), fmt, v);
+    out += buf;
+}
+
+static void append_point(std::string &out, const HistoryBucket &b) {
+    out += "[" + std::to_string(b.start) + "," + std::to_string(b.count) + ",";
+    append_fmt(out, "%.3f", b.count ? double(b.onCount) / b.count : 0.0);
+    for (size_t m = 0; m < H_METRIC_COUNT; m++) {
+        const HistoryStat &st = b.stat[m];
+        double k = kMetricScale[m];
+        append_fmt(out, ",%.2f", b.count ? st.sum * k / b.count : 0.0);
+        append_fmt(out, ",%g", st.min * k);
+        append_fmt(out, ",%g", st.max * k);
+    }
+    out += "]";
+}
+
+static void append_sample(std::string &out, const HistorySample &s) {
+    int16_t v[H_METRIC_COUNT];
+    sample_values(s, v);
+    out += "[" + std::to_string(s.time) + "," + std::to_string(s.state);
+    for (size_t m = 0; m < H_METRIC_COUNT; m++)
+        append_fmt(out, ",%g", v[m] * kMetricScale[m]);
+    out += "," + std::to_string(s.setpoint) + "," + std::to_string(s.flags & 1)
+         + "," + std::to_string((s.flags >> 1) & 1) + "]";
+}
+
+static void append_summary(std::string &out, const HistoryBucket &total) {
+    out += "\"samples\":" + std::to_string(total.count) + ",\"summary\":{";
+    if (total.count) {
+        for (size_t m = 0; m < H_METRIC_COUNT; m++) {
+            const HistoryStat &st = total.stat[m];
+            double k = kMetricScale[m];
+            out += std::string("\"") + kMetricName[m] + "\":{";
+            append_fmt(out, "\"min\":%g", st.min * k);
+            append_fmt(out, ",\"max\":%g", st.max * k);
+            append_fmt(out, ",\"avg\":%.2f},", st.sum * k / total.count);
+        }
+        append_fmt(out, "\"on_fraction\":%.3f", double(total.onCount) / total.count);
+    }
+    out += "}";
+}
+
+// ---- HistoryStore ----
+
+HistoryStore::~HistoryStore() {
+    close();
+}
+
+bool HistoryStore::open(const std::string &path, std::string *error) {
+    close();
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    size_t len = sizeof(Header) + sizeof(HistorySample) * kRawCapacity
+               + sizeof(HistoryBucket) * (kMinuteCapacity + kHourCapacity);
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    struct stat st;
+    if (fd < 0 || ::fstat(fd, &st) < 0) {
+        if (error) *error = path + ": " + std::strerror(errno);
+        if (fd >= 0) ::close(fd);
+        return false;
+    }
+    bool fresh = (size_t)st.st_size != len;
+    if (fresh && (::ftruncate(fd, 0) < 0 || ::ftruncate(fd, (off_t)len) < 0)) {
+        if (error) *error = path + ": " + std::strerror(errno);
+        ::close(fd);
+        return false;
+    }
+    void *map = ::mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        if (error) *error = path + ": mmap: " + std::strerror(errno);
+        return false;
+    }
+
+    _map     = map;
+    _len     = len;
+    _hdr     = static_cast<Header *>(map);
+    _raw     = reinterpret_cast<HistorySample *>(_hdr + 1);
+    _minutes = reinterpret_cast<HistoryBucket *>(_raw + kRawCapacity);
+    _hours   = _minutes + kMinuteCapacity;
+
+    if (fresh || std::memcmp(_hdr->magic, kMagic, sizeof(kMagic)) != 0 || _hdr->version != kVersion ||
+        _hdr->rawCapacity != kRawCapacity || _hdr->minuteCapacity != kMinuteCapacity ||
+        _hdr->hourCapacity != kHourCapacity)
+        reset();
+    return true;
+}
+
+void HistoryStore::reset() {
+    std::memset(_hdr, 0, sizeof(Header));
+    _hdr->version        = kVersion;
+    _hdr->rawCapacity    = kRawCapacity;
+    _hdr->minuteCapacity = kMinuteCapacity;
+    _hdr->hourCapacity   = kHourCapacity;
+    std::memcpy(_hdr->magic, kMagic, sizeof(kMagic)); // Last, so a torn reset is redone
+}
+
+void HistoryStore::close() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_map) return;
+    ::msync(_map, _len, MS_SYNC);
+    ::munmap(_map, _len);
+    _map = nullptr;
+    _hdr = nullptr;
+}
+
+void HistoryStore::flush() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_map) ::msync(_map, _len, MS_ASYNC);
+}
+
+void HistoryStore::record(uint32_t time, const heater_state_t &st, bool on) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_map || time < _hdr->lastTime) return;
+    _hdr->lastTime = time;
+
+    HistorySample s;
+    s.time        = time;
+    s.ambientTemp = st.ambientTemp;
+    s.caseTemp    = st.caseTemp;
+    s.voltage     = uint8_t(std::lround(std::fmin(st.voltage * 10.0f, 255.0f)));
+    s.pumpFreq    = uint8_t(std::lround(std::fmin(st.pumpFreq * 10.0f, 255.0f)));
+    s.rssi        = int8_t(st.rssi < -128 ? -128 : (st.rssi > 127 ? 127 : st.rssi));
+    s.setpoint    = st.setpoint;
+    s.state       = st.state;
+    s.flags       = (st.autoMode ? 1 : 0) | (on ? 2 : 0);
+
+    Header &h = *_hdr;
+    if (h.rawCount == 0 ||
+        time - ring_at(_raw, kRawCapacity, h.rawHead, h.rawCount, h.rawCount - 1).time >= _sampleInterval)
+        ring_push(_raw, kRawCapacity, h.rawHead, h.rawCount, s);
+
+    bucket_roll(h.minuteOpen, 60, time, _minutes, kMinuteCapacity, h.minuteHead, h.minuteCount);
+    bucket_add(h.minuteOpen, s, on);
+    bucket_roll(h.hourOpen, 3600, time, _hours, kHourCapacity, h.hourHead, h.hourCount);
+    bucket_add(h.hourOpen, s, on);
+}
+
+std::string HistoryStore::query(uint32_t from, uint32_t to, uint32_t step, size_t maxPoints) {
+    if (step == 0) step = to - from <= 86400 ? 60 : 3600;
+    else if (step < 60) step = 1;
+    else if (step < 3600) step = 60;
+    else step = 3600;
+
+    // Rollups cannot be split, so with step 60 or 3600 the points and the
+    // summary cover [from, to] widened to whole buckets; summary_from and
+    // summary_to give the span actually covered.
+    uint32_t span_from = from, span_to = to;
+    if (step > 1 && to >= from) {
+        span_from = from - from % step;
+        span_to   = to - to % step > UINT32_MAX - (step - 1) ? UINT32_MAX : to - to % step + (step - 1);
+    }
+    std::string out = "{\"from\":" + std::to_string(from) + ",\"to\":" + std::to_string(to)
+                    + ",\"step\":" + std::to_string(step)
+                    + ",\"summary_from\":" + std::to_string(span_from)
+                    + ",\"summary_to\":" + std::to_string(span_to) + ",";
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_map || to < from) {
+        out += "\"samples\":0,\"summary\":{},\"points\":[]}";
+        return out;
+    }
+    const Header &h = *_hdr;
+
+    HistoryBucket total;
+    bucket_init(total, from);
+    std::string points;
+    bool truncated = false;
+
+    if (step == 1) {
+        uint32_t first = ring_lower_bound(_raw, kRawCapacity, h.rawHead, h.rawCount, from);
+        uint32_t last  = to == UINT32_MAX ? h.rawCount
+                       : ring_lower_bound(_raw, kRawCapacity, h.rawHead, h.rawCount, to + 1);
+        uint32_t skip  = last - first > maxPoints ? uint32_t(last - first - maxPoints) : 0;
+        truncated = skip > 0;
+        for (uint32_t i = first; i < last; i++) {
+            const HistorySample &s = ring_at(_raw, kRawCapacity, h.rawHead, h.rawCount, i);
+            bucket_add(total, s, s.flags & 2);
+            if (i < first + skip) continue;
+            if (!points.empty()) points += ",";
+            append_sample(points, s);
+        }
+        out += "\"fields\":[\"time\",\"state\",\"ambient_temp\",\"case_temp\",\"voltage\","
+               "\"pump_freq\",\"rssi\",\"setpoint\",\"auto\",\"on\"],";
+    } else {
+        const HistoryBucket *ring = step == 60 ? _minutes : _hours;
+        uint32_t cap   = step == 60 ? kMinuteCapacity : kHourCapacity;
+        uint32_t head  = step == 60 ? h.minuteHead : h.hourHead;
+        uint32_t count = step == 60 ? h.minuteCount : h.hourCount;
+        const HistoryBucket &open = step == 60 ? h.minuteOpen : h.hourOpen;
+
+        uint32_t first = ring_lower_bound(ring, cap, head, count, from - from % step);
+        uint32_t last  = to == UINT32_MAX ? count : ring_lower_bound(ring, cap, head, count, to + 1);
+        bool with_open = open.count > 0 && open.start >= from - from % step && open.start <= to;
+        size_t n = (last - first) + (with_open ? 1 : 0);
+        size_t skip = n > maxPoints ? n - maxPoints : 0;
+        truncated = skip > 0;
+        for (uint32_t i = first; i < last; i++) {
+            const HistoryBucket &b = ring_at(ring, cap, head, count, i);
+            bucket_merge(total, b);
+            if (i - first < skip) continue;
+            if (!points.empty()) points += ",";
+            append_point(points, b);
+        }
+        if (with_open) {
+            bucket_merge(total, open);
+            if (!points.empty()) points += ",";
+            append_point(points, open);
+        }
+        out += "\"fields\":[\"time\",\"samples\",\"on_fraction\"";
+        for (size_t m = 0; m < H_METRIC_COUNT; m++) {
+            out += std::string(",\"") + kMetricName[m] + "_avg\"";
+            out += std::string(",\"") + kMetricName[m] + "_min\"";
+            out += std::string(",\"") + kMetricName[m] + "_max\"";
+        }
+        out += "],";
+    }
+
+    append_summary(out, total);
+    out += ",\"points\":[" + points + "],\"truncated\":" + (truncated ? "true" : "false") + "}";
+    return out;
+}
@@ -0,0 +1,113 @@
+/*
+ * Metrics.cpp
+ *
+ * Metrics registry and its Prometheus / JSON renderings.
+ */
+
+#include "Metrics.h"
+
+#include <cstdio>
+
+MetricsRegistry &metrics() {
+    static MetricsRegistry registry;
+    return registry;
+}
+
+MetricsRegistry::Entry &MetricsRegistry::entry(Kind kind, const char *name, const char *help) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (Entry &e : _entries) {
+        if (e.kind != kind || e.name != name) continue;
+        if (e.help.empty()) e.help = help;
+        return e;
+    }
+    _entries.emplace_back(kind, name, help);
+    return _entries.back();
+}
+
+Counter &MetricsRegistry::counter(const char *name, const char *help) {
+    return entry(Kind::Counter, name, help).counter;
+}
+
+Gauge &MetricsRegistry::gauge(const char *name, const char *help) {
+    return entry(Kind::Gauge, name, help).gauge;
+}
+
+Histogram &MetricsRegistry::histogram(const char *name, const char *help) {
+    return entry(Kind::Histogram, name, help).histogram;
+}
+
+static void append_seconds(std::string &out, uint64_t us) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.6f", us / 1e6);
+    out += buf;
+}
+
+std::string MetricsRegistry::prometheus() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::string out;
+    out.reserve(4096);
+    for (const Entry &e : _entries) {
+        out += "# HELP " + e.name + " " + e.help + "\n";
+        switch (e.kind) {
+            case Kind::Counter:
+                out += "# TYPE " + e.name + " counter\n";
+                out += e.name + " " + std::to_string(e.counter.value()) + "\n";
+                break;
+            case Kind::Gauge:
+                out += "# TYPE " + e.name + " gauge\n";
+                out += e.name + " " + std::to_string(e.gauge.value()) + "\n";
+                break;
+            case Kind::Histogram: {
+                out += "# TYPE " + e.name + " histogram\n";
+                uint64_t cumulative = 0;
+                for (size_t i = 0; i < Histogram::kBuckets; i++) {
+                    cumulative += e.histogram.bucket(i);
+                    out += e.name + "_bucket{le=\"";
+                    append_seconds(out, Histogram::kBoundsUs[i]);
+                    out += "\"} " + std::to_string(cumulative) + "\n";
+                }
+                cumulative += e.histogram.bucket(Histogram::kBuckets);
+                out += e.name + "_bucket{le=\"+Inf\"} " + std::to_string(cumulative) + "\n";
+                out += e.name + "_sum ";
+                append_seconds(out, e.histogram.sumUs());
+                out += "\n" + e.name + "_count " + std::to_string(cumulative) + "\n";
+                break;
+            }
+        }
+    }
+    return out;
+}
+
+std::string MetricsRegistry::json() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::string out = "{";
+    bool first = true;
+    auto field = [&](const std::string &name) {
+        if (!first) out += ",";
+        first = false;
+        out += "\"" + name + "\":";
+    };
+    for (const Entry &e : _entries) {
+        switch (e.kind) {
+            case Kind::Counter:
+                field(e.name);
+                out += std::to_string(e.counter.value());
+                break;
+            case Kind::Gauge:
+                field(e.name);
+                out += std::to_string(e.gauge.value());
+                break;
+            case Kind::Histogram: {
+                uint64_t count = 0;
+                for (size_t i = 0; i <= Histogram::kBuckets; i++) count += e.histogram.bucket(i);
+                field(e.name + "_count");
+                out += std::to_string(count);
+                field(e.name + "_sum");
+                append_seconds(out, e.histogram.sumUs());
+                break;
+            }
+        }
+    }
+    out += "}";
+    return out;
+}
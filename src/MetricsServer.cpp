@@ -0,0 +1,122 @@
+/*
+ * MetricsServer.cpp
+ *
+ * Prometheus scrape endpoint.
+ */
+
+#include "MetricsServer.h"
+#include "Metrics.h"
+
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstring>
+#include <netinet/in.h>
+#include <poll.h>
+#include <string>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+MetricsServer::~MetricsServer() {
+    stop();
+}
+
+bool MetricsServer::start(const char *address, uint16_t port) {
+    if (_thread.joinable()) return true;
+
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port   = htons(port);
+    if (::inet_pton(AF_INET, address, &addr.sin_addr) != 1) return false;
+
+    _listenFd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (_listenFd < 0) return false;
+    int one = 1;
+    ::setsockopt(_listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    if (::bind(_listenFd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || ::listen(_listenFd, 4) < 0) {
+        ::close(_listenFd);
+        _listenFd = -1;
+        return false;
+    }
+
+    _stopFd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    _thread = std::thread(&MetricsServer::run, this);
+    return true;
+}
+
+void MetricsServer::stop() {
+    if (_thread.joinable()) {
+        uint64_t one = 1;
+        (void)::write(_stopFd, &one, sizeof(one));
+        _thread.join();
+    }
+    if (_listenFd >= 0) ::close(_listenFd);
+    if (_stopFd >= 0) ::close(_stopFd);
+    _listenFd = -1;
+    _stopFd   = -1;
+}
+
+void MetricsServer::run() {
+    while (true) {
+        struct pollfd pfd[2] = { { _listenFd, POLLIN, 0 }, { _stopFd, POLLIN, 0 } };
+        if (::poll(pfd, 2, -1) < 0) continue;
+        if (pfd[1].revents & POLLIN) break;
+        if (!(pfd[0].revents & POLLIN)) continue;
+
+        int fd = ::accept4(_listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) continue;
+        // A client that stops reading must not block send() for good
+        struct timeval tv = { kClientTimeoutMs / 1000, (kClientTimeoutMs % 1000) * 1000 };
+        ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        serve(fd);
+        ::close(fd);
+    }
+}
+
+// Read the request line, answer, close. The whole request must arrive within
+// kClientTimeoutMs, and each send gives up after as long, so a slow or stuck
+// client cannot stall the next scrape (or stop()) for more than that.
+void MetricsServer::serve(int fd) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(kClientTimeoutMs);
+    char req[1024];
+    size_t len = 0;
+    while (len < sizeof(req) - 1) {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()).count();
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        if (left <= 0 || ::poll(&pfd, 1, (int)left) <= 0) return;
+        ssize_t n = ::read(fd, req + len, sizeof(req) - 1 - len);
+        if (n <= 0) return;
+        len += (size_t)n;
+        req[len] = '\0';
+        if (std::strstr(req, "\r\n\r\n") || std::strstr(req, "\n\n")) break;
+    }
+    req[len] = '\0';
+
+    std::string body;
+    const char *status;
+    const char *type = "text/plain; version=0.0.4";
+    if (std::strncmp(req, "GET /metrics", 12) == 0) {
+        status = "200 OK";
+        body   = metrics().prometheus();
+    } else {
+        status = "404 Not Found";
+        body   = "Not found\n";
+        type   = "text/plain";
+    }
+
+    std::string resp = std::string("HTTP/1.1 ") + status + "\r\n"
+                     + "Content-Type: " + type + "\r\n"
+                     + "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                     + "Connection: close\r\n\r\n" + body;
+    size_t off = 0;
+    deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(kClientTimeoutMs);
+    while (off < resp.size() && std::chrono::steady_clock::now() < deadline) {
+        ssize_t n = ::send(fd, resp.data() + off, resp.size() - off, MSG_NOSIGNAL);
+        if (n <= 0) return; // Includes SO_SNDTIMEO expiring
+        off += (size_t)n;
+    }
+}
@@ -0,0 +1,131 @@
+/*
+ * PiTransport.cpp
+ *
+ * CC1101 transport over spidev and GPIO.
+ */
+
+#include "PiTransport.h"
+#include "Metrics.h"
+#include "pi_arduino_compat.h"
+
+// Time spent polling MISO for CHIP_RDYn after asserting CS.
+static Histogram &chipReadyWait() {
+    static Histogram &h = metrics().histogram(
+        "cc1101_chip_ready_wait_seconds", "Time from CS assert to CHIP_RDYn low");
+    return h;
+}
+
+// Hardware CS mode: transactions repeated because CHIP_RDYn was set.
+static Counter &chipNotReady() {
+    static Counter &c = metrics().counter(
+        "cc1101_chip_not_ready_total", "SPI transactions repeated because CHIP_RDYn was high");
+    return c;
+}
+
+void PiTransport::begin() {
+    if (_csMode == CsMode::Hardware) {
+        // The SPI pins stay with the controller; only GDO2 is a GPIO.
+        pinEdgePi(_pinGdo2);
+        spi();
+        return;
+    }
+    pinModePi(_pinSck,  PI_OUTPUT);
+    pinModePi(_pinMosi, PI_OUTPUT);
+    pinModePi(_pinMiso, PI_INPUT);
+    pinModePi(_pinSs,   PI_OUTPUT);
+    digitalWritePi(_pinSs, PI_HIGH);
+    pinEdgePi(_pinGdo2);
+    spi();
+}
+
+PiSPI &PiTransport::spi() {
+    if (!_spi) _spi.reset(new PiSPI(_device, _speedHz));
+    return *_spi;
+}
+
+// GPIO CS mode, with CS asserted: wait for MISO (CHIP_RDYn) to go low.
+void PiTransport::waitChipReady() {
+    ScopedTimer t(chipReadyWait());
+    uint32_t start = micros();
+    while (digitalReadPi(_pinMiso)) {
+        if (micros() - start > kChipReadyTimeoutUs) {
+            digitalWritePi(_pinSs, PI_HIGH);
+            throw std::runtime_error("CC1101 not ready (CHIP_RDYn stuck high)");
+        }
+    }
+}
+
+void PiTransport::transfer(const uint8_t *tx, uint8_t *rx, size_t len) {
+    PiSPI &s = spi();
+    if (_csMode == CsMode::Hardware) {
+        // Bit 7 of the status byte is CHIP_RDYn as sampled when CE0 fell. If
+        // it is set the chip (e.g. waking from SLEEP or WOR) ignored the
+        // transaction, so it is safe to repeat.
+        uint32_t start = micros();
+        while (true) {
+            s.transfer_buf(tx, rx, len, _leadUs);
+            if (!(rx[0] & 0x80)) return;
+            chipNotReady().inc();
+            if (micros() - start > kChipReadyTimeoutUs)
+                throw std::runtime_error("CC1101 not ready (CHIP_RDYn stuck high)");
+        }
+    }
+    digitalWritePi(_pinSs, PI_LOW);
+    waitChipReady();
+    s.transfer_buf(tx, rx, len);
+    digitalWritePi(_pinSs, PI_HIGH);
+}
+
+// Hardware CS: send batch through send(first, count), one SPI message per
+// strobe. An operation that finds CHIP_RDYn set was ignored, but later ones
+// in the same message may still have gone through, and a strobe must not run
+// twice (SRES, SFRX) or ahead of what precedes it. So each strobe (a lone
+// header byte) starts a new message with the register accesses after it, and
+// a message is only sent once everything before it was taken. A message is
+// resumed from its first ignored operation: the strobe itself, or a register
+// access, which is safe to repeat.
+template <typename Send>
+static void sendUntilReady(PiSPIBatch &batch, uint32_t timeoutUs, Send &&send) {
+    uint32_t start = micros();
+    size_t first = 0;
+    while (first < batch.size()) {
+        size_t end = first + 1;
+        while (end < batch.size() && batch.len(end) != 1) end++;
+        send(first, end - first);
+        while (first < end && !(batch.rx(first)[0] & 0x80)) first++;
+        if (first == end) continue;
+        chipNotReady().inc();
+        if (micros() - start > timeoutUs)
+            throw std::runtime_error("CC1101 not ready (CHIP_RDYn stuck high)");
+    }
+}
+
+void PiTransport::transferBatch(PiSPIBatch &batch) {
+    PiSPI &s = spi();
+    if (_csMode == CsMode::Hardware) {
+        sendUntilReady(batch, kChipReadyTimeoutUs, [&](size_t first, size_t count) {
+            s.transfer_batch(batch, _leadUs, first, count);
+        });
+        return;
+    }
+    // GPIO CS: spidev's cs_change only toggles CE0, which is not wired to
+    // CSn here, so one message would reach the chip as a single transaction
+    // and a burst write would swallow everything after it. Frame each
+    // operation with its own CSn pulse and CHIP_RDYn wait instead.
+    CC1101Transport::transferBatch(batch);
+}
+
+bool PiTransport::waitForGdo2(uint32_t timeoutMs, int cancelFd) {
+    return waitForHighPi(_pinGdo2, timeoutMs, cancelFd);
+}
+
+bool PiTransport::setSpeed(uint32_t hz) {
+    spi().setSpeed(hz);
+    _speedHz = hz;
+    return true;
+}
+
+const char *PiTransport::name() const {
+    if (_csMode == CsMode::Hardware) return "spidev, hardware CS";
+    return gpioLineFd(_pinSs) >= 0 ? "spidev, CS via gpiochip" : "spidev, CS via sysfs";
+}
@@ -0,0 +1,237 @@
+/*
+ * RadioWorker.cpp
+ *
+ * Serializes all access to the CC1101 onto one thread.
+ */
+
+#include "RadioWorker.h"
+#include "Metrics.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+static Gauge &queueDepthGauge() {
+    static Gauge &g = metrics().gauge("radio_queue_depth", "Radio jobs waiting to run");
+    return g;
+}
+
+static Histogram &commandLatency() {
+    static Histogram &h = metrics().histogram(
+        "radio_command_queue_latency_seconds", "Time from queueing a command to it starting on the radio");
+    return h;
+}
+
+RadioWorker::RadioWorker(DieselHeaterRF &heater) : _heater(heater) {
+    _cancelFd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (_cancelFd < 0)
+        throw std::runtime_error("eventfd failed");
+    _heater.setCancelFd(_cancelFd);
+    _heater.setStopFlag(&_stopping);
+    queueDepthGauge();
+    commandLatency();
+}
+
+RadioWorker::~RadioWorker() {
+    stop();
+    _heater.setCancelFd(-1);
+    _heater.setStopFlag(nullptr);
+    if (_cancelFd >= 0) ::close(_cancelFd);
+}
+
+void RadioWorker::start() {
+    if (_thread.joinable()) return;
+    _stop = false;
+    _stopping = false;
+    _thread = std::thread(&RadioWorker::run, this);
+}
+
+void RadioWorker::stop() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _stopping = true;
+    _cv.notify_all();
+    uint64_t one = 1;
+    (void)::write(_cancelFd, &one, sizeof(one)); // Break any receive in progress
+    if (_thread.joinable()) _thread.join();
+}
+
+std::future<void> RadioWorker::sendCommand(uint8_t cmd) {
+    return submit(Priority::Command, [this, cmd](DieselHeaterRF &h) {
+        std::cout << "Command 0x" << std::hex << int(cmd) << std::dec
+                  << " on air after " << lastCommandLatencyUs() / 1000.0 << " ms"
+                  << " (queue depth " << queueDepth() << ")\n" << std::flush;
+        h.sendCommand(cmd);
+    });
+}
+
+std::future<void> RadioWorker::sendCommand(uint8_t cmd, uint32_t addr) {
+    return submit(Priority::Command, [this, cmd, addr](DieselHeaterRF &h) {
+        std::cout << "Command 0x" << std::hex << int(cmd) << " to 0x" << addr << std::dec
+                  << " on air after " << lastCommandLatencyUs() / 1000.0 << " ms"
+                  << " (queue depth " << queueDepth() << ")\n" << std::flush;
+        h.sendCommand(cmd, addr);
+    });
+}
+
+std::future<heater_ack_t> RadioWorker::sendCommandAcked(uint8_t cmd, uint32_t addr,
+                                                        std::function<bool(const heater_state_t &)> acked,
+                                                        std::function<void(const heater_ack_t &)> done) {
+    uint8_t burst = _ackBurst, frames = _ackFrames;
+    uint16_t listen = _ackListen;
+    return submit(Priority::Command, [=](DieselHeaterRF &h) {
+        std::cout << "Command 0x" << std::hex << int(cmd) << " to 0x" << addr << std::dec
+                  << " (acknowledged) on air after " << lastCommandLatencyUs() / 1000.0 << " ms"
+                  << " (queue depth " << queueDepth() << ")\n" << std::flush;
+        heater_ack_t result;
+        h.sendCommandAcked(cmd, addr, acked, &result, burst, frames, listen);
+        std::cout << "Command 0x" << std::hex << int(cmd) << std::dec
+                  << (result.delivered ? " delivered" : result.txFailed ? " aborted, TX failed," : " not acknowledged") << " after "
+                  << int(result.frames) << " frame(s) in " << int(result.bursts) << " burst(s), "
+                  << result.elapsedMs << " ms\n" << std::flush;
+        if (done) done(result);
+        return result;
+    });
+}
+
+std::future<heater_ack_t> RadioWorker::sendSteps(uint8_t cmd, uint8_t count, uint32_t addr,
+                                                 std::function<bool(const heater_state_t &)> reached,
+                                                 std::function<void(const heater_ack_t &)> done) {
+    uint8_t burst = _ackBurst;
+    uint16_t listen = _ackListen;
+    return submit(Priority::Command, [=](DieselHeaterRF &h) {
+        std::cout << int(count) << " x command 0x" << std::hex << int(cmd) << " to 0x" << addr << std::dec
+                  << " (pipelined) on air after " << lastCommandLatencyUs() / 1000.0 << " ms\n" << std::flush;
+        heater_ack_t result;
+        h.sendSteps(cmd, count, addr, reached, &result, burst, listen);
+        std::cout << "Steps " << (result.delivered ? "reached target" : result.txFailed ? "aborted, TX failed," : "did not reach target")
+                  << " after " << int(result.frames) << " frame(s), " << result.elapsedMs << " ms\n" << std::flush;
+        if (done) done(result);
+        return result;
+    });
+}
+
+std::future<std::optional<heater_state_t>> RadioWorker::getState(uint32_t timeout) {
+    return submit(Priority::Poll, [timeout](DieselHeaterRF &h) -> std::optional<heater_state_t> {
+        heater_state_t st{};
+        if (h.getState(&st, timeout)) return st;
+        return std::nullopt;
+    });
+}
+
+std::future<void> RadioWorker::setAddress(uint32_t addr) {
+    return submit(Priority::Command, [addr](DieselHeaterRF &h) { h.setAddress(addr); });
+}
+
+std::future<void> RadioWorker::setWakeOnRadio(bool enable, uint16_t periodMs, uint8_t rxTime) {
+    return submit(Priority::Command, [=](DieselHeaterRF &h) {
+        h.setWakeOnRadio(enable, periodMs, rxTime);
+    });
+}
+
+void RadioWorker::setStreaming(HeaterFrameRing *ring, int notifyFd) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _ring     = ring;
+        _notifyFd = notifyFd;
+        if (!ring && _busy && _running == Priority::Background) {
+            // Stop the streaming listen in progress, but not a job's own
+            // receive waits: signalled under the lock, so the worker drains
+            // it before starting its next job. The radio is returned to IDLE
+            // by the next job that needs it.
+            uint64_t one = 1;
+            (void)::write(_cancelFd, &one, sizeof(one));
+        }
+    }
+    _cv.notify_one();
+}
+
+void RadioWorker::enqueue(Priority prio, std::function<void(DieselHeaterRF &)> run) {
+    bool preempt;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _queue.push(Job{prio, _seq++, std::chrono::steady_clock::now(), std::move(run)});
+        _depth.store(_queue.size(), std::memory_order_relaxed);
+        queueDepthGauge().set((int64_t)_queue.size());
+        preempt = _busy && prio < _running;
+    }
+    _cv.notify_one();
+    if (preempt) {
+        uint64_t one = 1;
+        (void)::write(_cancelFd, &one, sizeof(one));
+    }
+}
+
+void RadioWorker::drainCancel() {
+    uint64_t v;
+    while (::read(_cancelFd, &v, sizeof(v)) == sizeof(v)) {}
+}
+
+void RadioWorker::run() {
+    while (true) {
+        Job job;
+        HeaterFrameRing *stream = nullptr;
+        int notifyFd = -1;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _busy = false;
+            _cv.wait(lock, [this] { return _stop || !_queue.empty() || _ring; });
+            if (_stop) break;
+            if (_queue.empty()) {
+                stream   = _ring;
+                notifyFd = _notifyFd;
+                _running = Priority::Background;
+            } else {
+                job = _queue.top();
+                _queue.pop();
+                _depth.store(_queue.size(), std::memory_order_relaxed);
+                queueDepthGauge().set((int64_t)_queue.size());
+                _running = job.prio;
+            }
+            _busy = true;
+            // Drain under the lock so a preemption signalled after this point
+            // is never lost.
+            drainCancel();
+        }
+
+        if (stream) {
+            streamOnce(stream, notifyFd);
+            continue;
+        }
+
+        if (job.prio == Priority::Command) {
+            auto waited = std::chrono::steady_clock::now() - job.queued;
+            uint32_t us = (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(waited).count();
+            _lastCmdLatencyUs.store(us, std::memory_order_relaxed);
+            commandLatency().observeUs(us);
+            if (us > _maxCmdLatencyUs.load(std::memory_order_relaxed))
+                _maxCmdLatencyUs.store(us, std::memory_order_relaxed);
+        }
+
+        job.run(_heater);
+    }
+
+    // Abandon anything still queued; waiting futures see broken_promise.
+    std::lock_guard<std::mutex> lock(_mutex);
+    while (!_queue.empty()) _queue.pop();
+    _depth.store(0, std::memory_order_relaxed);
+}
+
+void RadioWorker::streamOnce(HeaterFrameRing *ring, int notifyFd) {
+    try {
+        heater_frame_t frame;
+        if (_heater.receiveFrame(&frame, 1000)) {
+            ring->push(frame);
+            if (notifyFd >= 0) {
+                uint64_t one = 1;
+                (void)::write(notifyFd, &one, sizeof(one));
+            }
+        }
+    } catch (const std::exception &e) {
+        std::cerr << "Streaming receive error: " << e.what() << "\n" << std::flush;
+        delay(1000);
+    }
+}
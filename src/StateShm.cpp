@@ -0,0 +1,125 @@
+/*
+ * StateShm.cpp
+ *
+ * Shared-memory live state: segment setup for the writer and readers.
+ */
+
+#include "StateShm.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static constexpr char kMagic[8] = { 'D', 'H', 'S', 'T', 'A', 'T', 'E', 0 };
+
+static bool fail(std::string *error, const std::string &what) {
+    if (error) *error = what;
+    return false;
+}
+
+StateShmWriter::~StateShmWriter() {
+    close();
+}
+
+bool StateShmWriter::open(const std::string &name, std::string *error) {
+    close();
+    int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return fail(error, name + ": " + std::strerror(errno));
+    if (::ftruncate(fd, sizeof(StateShmSegment)) < 0) {
+        ::close(fd);
+        return fail(error, name + ": " + std::strerror(errno));
+    }
+    void *map = ::mmap(nullptr, sizeof(StateShmSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) return fail(error, name + ": mmap: " + std::strerror(errno));
+
+    // Start from a clean segment: a reader still mapping a previous one sees
+    // the header invalidated first.
+    std::memset(map, 0, sizeof(StateShmSegment));
+    _seg = new (map) StateShmSegment();
+    StateShmHeader &h = _seg->header;
+    h.version   = kStateShmVersion;
+    h.slotSize  = sizeof(StateShmSlot);
+    h.slotCount = kStateShmSlots;
+    h.writerPid.store((int32_t)::getpid(), std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(h.magic, kMagic, sizeof(kMagic));
+    _name = name;
+    return true;
+}
+
+void StateShmWriter::close() {
+    if (!_seg) return;
+    _seg->header.writerPid.store(0, std::memory_order_release);
+    ::munmap(_seg, sizeof(StateShmSegment));
+    ::shm_unlink(_name.c_str());
+    _seg = nullptr;
+}
+
+void StateShmWriter::update(size_t slot, uint32_t addr, const heater_state_t &st,
+                            uint64_t timestampUs, uint64_t frames) {
+    if (!_seg || slot >= kStateShmSlots) return;
+    StateShmSlot &s = _seg->slots[slot];
+    uint64_t seq = s.seq.load(std::memory_order_relaxed);
+    s.seq.store(seq + 1, std::memory_order_relaxed); // Odd: write in progress
+    std::atomic_thread_fence(std::memory_order_release);
+    s.snap.addr        = addr;
+    s.snap.timestampUs = timestampUs;
+    s.snap.frames      = frames;
+    s.snap.state       = st;
+    s.seq.store(seq + 2, std::memory_order_release);
+
+    StateShmHeader &h = _seg->header;
+    if (h.heaters.load(std::memory_order_relaxed) <= slot)
+        h.heaters.store(uint32_t(slot + 1), std::memory_order_release);
+    h.updates.fetch_add(1, std::memory_order_relaxed);
+}
+
+void StateShmWriter::setCounters(uint64_t rxPackets, uint64_t rxCrcErrors) {
+    if (!_seg) return;
+    _seg->header.rxPackets.store(rxPackets, std::memory_order_relaxed);
+    _seg->header.rxCrcErrors.store(rxCrcErrors, std::memory_order_relaxed);
+}
+
+StateShmReader::~StateShmReader() {
+    close();
+}
+
+bool StateShmReader::open(const std::string &name, std::string *error) {
+    close();
+    int fd = ::shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) return fail(error, name + ": " + std::strerror(errno));
+    struct stat st;
+    if (::fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(StateShmSegment)) {
+        ::close(fd);
+        return fail(error, name + ": not a heater state segment");
+    }
+    void *map = ::mmap(nullptr, sizeof(StateShmSegment), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) return fail(error, name + ": mmap: " + std::strerror(errno));
+
+    const StateShmSegment *seg = static_cast<const StateShmSegment *>(map);
+    const StateShmHeader &h = seg->header;
+    if (std::memcmp(h.magic, kMagic, sizeof(kMagic)) != 0 || h.version != kStateShmVersion ||
+        h.slotSize != sizeof(StateShmSlot) || h.slotCount != kStateShmSlots) {
+        ::munmap(map, sizeof(StateShmSegment));
+        return fail(error, name + ": segment layout does not match this build");
+    }
+    _seg = seg;
+    return true;
+}
+
+bool StateShmReader::writerAlive() const {
+    int32_t pid = _seg->header.writerPid.load(std::memory_order_acquire);
+    return pid > 0 && (::kill(pid, 0) == 0 || errno == EPERM);
+}
+
+void StateShmReader::close() {
+    if (_seg) ::munmap(const_cast<StateShmSegment *>(_seg), sizeof(StateShmSegment));
+    _seg = nullptr;
+}
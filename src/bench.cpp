@@ -0,0 +1,341 @@
+/*
+ * bench.cpp
+ *
+ * Microbenchmarks of the bridge's hot paths, one JSON line per benchmark,
+ * for tracking regressions between releases. Needs neither MQTT nor a
+ * radio: SPI runs against an in-memory transport.
+ */
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "CC1101Transport.h"
+#include "DeltaPublisher.h"
+#include "DieselHeaterRF.h"
+#include "HistoryStore.h"
+#include "StatePublisher.h"
+#include "StateShm.h"
+#include "TelemetryFormat.h"
+#include "crc16_modbus.h"
+
+// Every heap allocation in the process, for -a.
+static std::atomic<uint64_t> g_allocations{0};
+
+void *operator new(size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+
+// Keep v (and everything it was computed from) alive past the optimizer.
+template <typename T>
+static inline void keep(const T &v) {
+    asm volatile("" : : "r,m"(v) : "memory");
+}
+
+// Answers like an idle CC1101 with nothing received: status byte "IDLE,
+// FIFO empty", MARCSTATE IDLE, zero everywhere else. Transactions are only
+// counted, so DieselHeaterRF's own per-transaction cost is what is measured.
+class NullTransport : public CC1101Transport
+{
+
+public:
+
+    uint64_t transfers = 0;
+
+    void begin() override {}
+    void transfer(const uint8_t *tx, uint8_t *rx, size_t len) override {
+        transfers++;
+        std::memset(rx, 0, len);
+        rx[0] = 0x0F;
+        if (len == 2 && tx[0] == 0xF5) rx[1] = 0x01; // MARCSTATE: IDLE
+    }
+    bool waitForGdo2(uint32_t, int) override { return false; }
+    const char *name() const override { return "null"; }
+};
+
+// 64 distinct status packets, as the heater sends them.
+static std::vector<std::array<char, 24>> status_packets() {
+    std::vector<std::array<char, 24>> out(64);
+    for (size_t i = 0; i < out.size(); i++) {
+        uint8_t *f = reinterpret_cast<uint8_t *>(out[i].data());
+        std::memset(f, 0, 24);
+        uint32_t addr = 0x12345678u + uint32_t(i) * 0x01010101u;
+        f[0]  = 21;
+        f[2]  = uint8_t(addr >> 24);
+        f[3]  = uint8_t(addr >> 16);
+        f[4]  = uint8_t(addr >> 8);
+        f[5]  = uint8_t(addr);
+        f[6]  = uint8_t(i % 9);
+        f[7]  = uint8_t(i % 6);
+        f[9]  = uint8_t(120 + i % 10);
+        f[10] = uint8_t(int8_t(15 + int(i % 10)));
+        f[12] = uint8_t(60 + i);
+        f[13] = uint8_t(8 + i % 29);
+        f[14] = (i & 1) ? 0x32 : 0xCD;
+        f[15] = uint8_t(10 + i % 46);
+        uint16_t crc = crc16::compute(f, 19);
+        f[19] = uint8_t(crc >> 8);
+        f[20] = uint8_t(crc);
+        f[22] = uint8_t(int8_t((-60 + int(i % 7) + 74) * 2));
+        f[23] = 0x80 | 0x0C;
+    }
+    return out;
+}
+
+struct Bench {
+    const char *name;
+    // Run iters iterations; returns the operations done (usually iters).
+    std::function<uint64_t(uint64_t iters)> run;
+};
+
+static std::vector<Bench> benches() {
+    static const std::vector<std::array<char, 24>> packets = status_packets();
+
+    std::vector<Bench> b;
+
+    // What DieselHeaterRF::crc16_2 computes for every received packet
+    b.push_back({ "crc16_2", [](uint64_t iters) {
+        uint16_t acc = 0;
+        for (uint64_t i = 0; i < iters; i++)
+            acc ^= crc16::compute(reinterpret_cast<const uint8_t *>(packets[i & 63].data()), 19);
+        keep(acc);
+        return iters;
+    } });
+
+    // getState() / receiveFrame() consumers: bytes to heater_state_t
+    b.push_back({ "decode_state", [](uint64_t iters) {
+        heater_state_t st;
+        for (uint64_t i = 0; i < iters; i++) {
+            DieselHeaterRF::decodeState(packets[i & 63].data(), &st);
+            keep(st);
+        }
+        return iters;
+    } });
+
+    b.push_back({ "parse_address", [](uint64_t iters) {
+        uint32_t acc = 0;
+        for (uint64_t i = 0; i < iters; i++)
+            acc += DieselHeaterRF::parseAddress(packets[i & 63].data());
+        keep(acc);
+        return iters;
+    } });
+
+    // The state/raw JSON document
+    b.push_back({ "state_raw_json", [](uint64_t iters) {
+        heater_state_t states[64];
+        for (size_t i = 0; i < 64; i++) DieselHeaterRF::decodeState(packets[i].data(), &states[i]);
+        PayloadBuffer out;
+        for (uint64_t i = 0; i < iters; i++) {
+            format_state_raw(out, states[i & 63]);
+            keep(out);
+        }
+        return iters;
+    } });
+
+    // handle_command's per-heater topic matching, over 8 multi-heater trees,
+    // for a mix of first-heater, last-heater and unknown topics.
+    b.push_back({ "topic_dispatch", [](uint64_t iters) {
+        const std::string base = HEATER_TOPIC_BASE;
+        std::vector<HeaterTopics> trees;
+        for (uint32_t k = 0; k < 8; k++) trees.push_back(heater_topics(base, 0x10000000u + k, true));
+        const std::string topics[4] = {
+            trees[0].power_c, trees[7].cmd_down, trees[3].history_get, base + "unknown/set",
+        };
+        uint64_t matched = 0;
+        for (uint64_t i = 0; i < iters; i++) {
+            const std::string &topic = topics[i & 3];
+            for (const HeaterTopics &t : trees) {
+                if (classify_topic(t, topic) != HeaterTopicKind::None) {
+                    matched++;
+                    break;
+                }
+            }
+        }
+        keep(matched);
+        return iters;
+    } });
+
+    // DieselHeaterRF's SPI primitives (framing, metrics, shadow checks) per
+    // transaction, driven through a one-packet command send.
+    b.push_back({ "spi_transaction", [](uint64_t iters) {
+        static NullTransport transport;
+        static DieselHeaterRF radio(transport);
+        static bool started = false;
+        if (!started) {
+            radio.setColdStart(true);
+            radio.begin();
+            started = true;
+        }
+        uint64_t before = transport.transfers;
+        for (uint64_t i = 0; i < iters; i++) radio.sendCommand(HEATER_CMD_WAKEUP, 0x12345678u, 1);
+        return transport.transfers - before;
+    } });
+
+    return b;
+}
+
+struct Result {
+    uint64_t iters = 0, ops = 0;
+    double   best_ns = 0, median_ns = 0;
+};
+
+static double run_once(const Bench &b, uint64_t iters, uint64_t *ops) {
+    auto start = std::chrono::steady_clock::now();
+    *ops = b.run(iters);
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Size the run to about target_s, then time repeats runs of that size.
+static Result measure(const Bench &b, double target_s, unsigned repeats) {
+    uint64_t iters = 1, ops = 0;
+    double ns = run_once(b, iters, &ops);
+    while (ns < 1e7 && iters < (1ull << 40)) {
+        iters *= 2;
+        ns = run_once(b, iters, &ops);
+    }
+    iters = std::max<uint64_t>(1, uint64_t(double(iters) * target_s * 1e9 / ns));
+
+    std::vector<double> per_op;
+    for (unsigned r = 0; r < repeats; r++) {
+        ns = run_once(b, iters, &ops);
+        per_op.push_back(ns / double(ops ? ops : 1));
+    }
+    std::sort(per_op.begin(), per_op.end());
+
+    Result res;
+    res.iters     = iters;
+    res.ops       = ops;
+    res.best_ns   = per_op.front();
+    res.median_ns = per_op[per_op.size() / 2];
+    return res;
+}
+
+// What publish_state() does for each received state, minus the broker: the
+// shared-memory snapshot, the history sample and the telemetry topics. After
+// a warm-up (first-use statics, the first full refresh) a cycle must not
+// touch the heap. Returns the process exit status.
+static int check_allocations(unsigned cycles) {
+    static const std::vector<std::array<char, 24>> packets = status_packets();
+
+    HeaterTopics topics = heater_topics(HEATER_TOPIC_BASE, 0x12345678u, true);
+    DeltaPublisher delta;
+    DeltaPolicy().apply(delta);
+
+    std::string error;
+    std::string shm_name = "/diesel_heater_bench." + std::to_string(::getpid());
+    StateShmWriter shm;
+    if (!shm.open(shm_name, &error)) {
+        std::fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    std::string history_path = "/tmp/diesel_heater_bench." + std::to_string(::getpid()) + ".bin";
+    HistoryStore history;
+    if (!history.open(history_path, &error)) {
+        std::fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    history.setSampleInterval(5);
+
+    uint64_t published = 0, allocations = 0;
+    uint32_t now = 1700000000;
+    auto sink = [&published](const std::string &topic, const char *payload, size_t len) {
+        keep(topic);
+        keep(payload);
+        published += len ? 1 : 0;
+    };
+    const unsigned warmup = 64;
+    for (unsigned i = 0; i < warmup + cycles; i++) {
+        if (i == warmup) {
+            published   = 0;
+            allocations = g_allocations.load(std::memory_order_relaxed);
+        }
+        heater_state_t st;
+        DieselHeaterRF::decodeState(packets[i & 63].data(), &st);
+        now += 5;
+        shm.update(0, 0x12345678u, st, uint64_t(now) * 1000000u, i);
+        shm.setCounters(i, 0);
+        history.record(now, st, heater_is_on(st.state));
+        publish_telemetry(sink, topics, delta, st, now * 1000u);
+    }
+    allocations = g_allocations.load(std::memory_order_relaxed) - allocations;
+
+    history.close();
+    shm.close();
+    ::unlink(history_path.c_str());
+
+    std::printf("{\"check\":\"allocations\",\"cycles\":%u,\"messages\":%" PRIu64
+                ",\"allocations\":%" PRIu64 ",\"ok\":%s}\n",
+                cycles, published, allocations, allocations == 0 ? "true" : "false");
+    return allocations == 0 ? 0 : 1;
+}
+
+static void usage(const char *argv0) {
+    std::fprintf(stderr,
+        "usage: %s [-f name] [-t seconds] [-r repeats] [-l] [-a]\n"
+        "  -f name     run only benchmarks whose name contains name\n"
+        "  -t seconds  target time per repeat (default 0.2)\n"
+        "  -r repeats  timed repeats per benchmark; best and median reported (default 5)\n"
+        "  -l          list benchmarks\n"
+        "  -a          instead, check that a telemetry publish cycle does not allocate;\n"
+        "              exits 1 if it does\n", argv0);
+}
+
+int main(int argc, char **argv) {
+    std::string filter;
+    double   target_s = 0.2;
+    unsigned repeats  = 5;
+    bool     list     = false;
+    bool     allocs   = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "f:t:r:lah")) != -1) {
+        switch (opt) {
+            case 'f': filter = optarg; break;
+            case 't': target_s = std::atof(optarg); break;
+            case 'r': repeats = (unsigned)std::strtoul(optarg, nullptr, 10); break;
+            case 'l': list = true; break;
+            case 'a': allocs = true; break;
+            default:  usage(argv[0]); return 2;
+        }
+    }
+    if (optind != argc || target_s <= 0 || repeats == 0) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (allocs) return check_allocations(10000);
+
+    unsigned ran = 0;
+    for (const Bench &b : benches()) {
+        if (!filter.empty() && std::string(b.name).find(filter) == std::string::npos) continue;
+        if (list) {
+            std::printf("%s\n", b.name);
+            continue;
+        }
+        Result r = measure(b, target_s, repeats);
+        std::printf("{\"bench\":\"%s\",\"ns_per_op\":%.2f,\"ns_per_op_median\":%.2f,"
+                    "\"ops_per_s\":%.0f,\"ops\":%" PRIu64 ",\"iterations\":%" PRIu64 ",\"repeats\":%u}\n",
+                    b.name, r.best_ns, r.median_ns, 1e9 / r.best_ns, r.ops, r.iters, repeats);
+        std::fflush(stdout);
+        ran++;
+    }
+    if (!list && ran == 0) {
+        std::fprintf(stderr, "no benchmark matches '%s'\n", filter.c_str());
+        return 1;
+    }
+    return 0;
+}
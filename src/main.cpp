@@ -3,74 +3,229 @@
 #include <fstream>
 #include <string>
 #include <cstring>
+#include <cmath>
+#include <cstdio>
 #include <csignal>
 #include <thread>
 #include <atomic>
 #include <chrono>
+#include <ctime>
+#include <future>
+#include <optional>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 
 #include <mosquitto.h>          // libmosquitto [web:72]
 
+#include "CC1101Sim.h"
+#include "CaptureFile.h"
+#include "DeltaPublisher.h"
 #include "DieselHeaterRF.h"
+#include "EventLoop.h"
+#include "HistoryStore.h"
+#include "Metrics.h"
+#include "MetricsServer.h"
+#include "PacketRing.h"
+#include "PiTransport.h"
+#include "RadioWorker.h"
+#include "StatePublisher.h"
+#include "StateShm.h"
+#include "TelemetryFormat.h"
 #include "pi_arduino_compat.h"
 #include "pi_gpio.h"
 #include "pi_spi.h"
-
-// Global SPI instance used by DieselHeaterRF
-// PiSPI g_spi("/dev/spidev0.0", 4000000);
-PiSPI g_spi("/dev/spidev0.0", 250000);
+#include "pi_syscalls.h"
 
 static std::atomic<bool> g_running{true};
-static std::atomic<uint8_t> g_last_state_code{HEATER_STATE_OFF};
 static std::atomic<bool> g_pairing{false};
+static std::atomic<bool> g_radio_stopped{false}; // No more frames will arrive
+
+// Set in event-loop mode (EVENT_LOOP=1): MQTT, frames, timers and signals are
+// all handled on the main thread, and radio-thread completions are posted to it.
+static EventLoop *g_loop = nullptr;
+
+// Multi-heater mode: one radio decodes every heater in range and each paired
+// address gets its own topic tree and HA device.
+static bool g_multi = false;
+
+// Continuous-RX mode: every received frame lands in this ring and each
+// consumer (publisher, pairing) reads it with its own cursor.
+static bool g_streaming = false;
+static HeaterFrameRing g_rx_ring;
+
+// Wake-on-Radio listening instead of continuous RX (rx_mode/set), and its
+// duty-cycle settings (WOR_PERIOD_MS, WOR_RX_TIME)
+static std::atomic<bool> g_wor{false};
+static uint16_t g_wor_period_ms = 25;
+static uint8_t  g_wor_rx_time   = 0;
+
+// Acknowledged commands: send in bursts and stop once the heater's status
+// shows the command took effect.
+static bool g_ack_commands = false;
 
 // MQTT / HA configuration
 static const char *MQTT_USER      = nullptr;          // or "user"
 static const char *MQTT_PASS      = nullptr;          // or "pass"
 static const char *CLIENT_ID      = "diesel_heater";
-static const char *ADDR_FILE      = "/data/addr.txt"; // path on Pi
+static const char *ADDR_FILE      = HEATER_ADDR_FILE; // path on Pi
+static const char *FREQ_FILE      = "/data/freq_offsets.txt"; // Learned offsets (FREQ_TRACKING)
+
+// Telemetry history files live here (HISTORY_DIR; HISTORY=0 disables)
+static bool        g_history          = false;
+static std::string g_history_dir      = "/data";
+static uint32_t    g_history_sample_s = 5;
 
 // Base topics
-static const std::string BASE      = "home/diesel_heater/";
+static const std::string BASE      = HEATER_TOPIC_BASE;
 
-// High-level control topics
-static const std::string T_POWER_C = BASE + "power/set";
-static const std::string T_POWER_S = BASE + "power/state";
-static const std::string T_MODE_C  = BASE + "mode/set";
-static const std::string T_MODE_S  = BASE + "mode/state";
+// Bridge-wide topics (not per heater)
 static const std::string T_PAIR_C  = BASE + "pair/set";
 static const std::string T_PAIR_S  = BASE + "pair/state";
 
-// Low-level command topics
-static const std::string T_CMD_WAKEUP = BASE + "cmd/wakeup";
-static const std::string T_CMD_MODE   = BASE + "cmd/mode";
-static const std::string T_CMD_POWER  = BASE + "cmd/power";
-static const std::string T_CMD_UP     = BASE + "cmd/up";
-static const std::string T_CMD_DOWN   = BASE + "cmd/down";
-
-// State and sensor topics
-static const std::string T_STATE_RAW  = BASE + "state/raw";
-static const std::string T_TEMP       = BASE + "ambient_temp";
-static const std::string T_VOLT       = BASE + "voltage";
-static const std::string T_CASE       = BASE + "case_temp";
-static const std::string T_PFREQ      = BASE + "pump_freq";
-static const std::string T_HSTATE     = BASE + "state_code";
-static const std::string T_HSTATE_TXT = BASE + "state/text";
-static const std::string T_RSSI       = BASE + "rssi";
-
 // Availability
 static const std::string T_AVAIL      = BASE + "status";
 
+// Periodic metrics snapshot (JSON), when MQTT_STATS_S is set
+static const std::string T_STATS      = BASE + "stats";
+
+// Receive mode (continuous|wor) and the frame capture rate it achieves
+static const std::string T_RXMODE_C   = BASE + "rx_mode/set";
+static const std::string T_RXMODE_S   = BASE + "rx_mode/state";
+static const std::string T_CAPTURE    = BASE + "rx_capture";
+
 // Discovery topics
-static const std::string DISC_POWER   = "homeassistant/switch/diesel_heater/power/config";
 static const std::string DISC_PAIR    = "homeassistant/switch/diesel_heater/pair/config";
-static const std::string DISC_MODE    = "homeassistant/select/diesel_heater/mode/config";
-static const std::string DISC_TEMP    = "homeassistant/sensor/diesel_heater/ambient_temp/config";
-static const std::string DISC_VOLT    = "homeassistant/sensor/diesel_heater/voltage/config";
-static const std::string DISC_CASE    = "homeassistant/sensor/diesel_heater/case_temp/config";
-static const std::string DISC_PFREQ   = "homeassistant/sensor/diesel_heater/pump_freq/config";
-static const std::string DISC_HSTATE  = "homeassistant/sensor/diesel_heater/state_code/config";
-static const std::string DISC_HTEXT   = "homeassistant/sensor/diesel_heater/state_text/config";
-static const std::string DISC_RSSI    = "homeassistant/sensor/diesel_heater/rssi/config";
+static const std::string DISC_RXMODE  = "homeassistant/select/diesel_heater/rx_mode/config";
+static const std::string DISC_CAPTURE = "homeassistant/sensor/diesel_heater/rx_capture/config";
+
+// One entry of the per-address state table.
+struct Heater {
+    std::atomic<uint32_t> addr{0};
+    HeaterTopics topics;
+    std::atomic<uint8_t> last_state_code{HEATER_STATE_OFF};
+    DeltaPublisher delta;
+
+    // Latest decoded state not yet published and the packet count; owned by
+    // the state thread.
+    PendingState   pending;
+    size_t         shm_slot = 0;
+
+    // Last state heard from the heater, the baseline for judging whether a
+    // command took effect.
+    std::mutex     seen_mutex;
+    heater_state_t seen{};
+    bool           have_seen = false;
+
+    // On-disk telemetry history (open unless disabled or unwritable)
+    HistoryStore   history;
+
+    // rx_quality report window and the offset last written to FREQ_FILE;
+    // owned by the state thread.
+    uint64_t       quality_us = 0;
+    uint64_t       quality_frames = 0, quality_good = 0, quality_bad = 0;
+    float          saved_offset = 0;
+    bool           offset_saved = false;
+
+    Heater(uint32_t address, HeaterTopics t) : addr(address), topics(std::move(t)) {}
+};
+
+// Entries are only ever added, so Heater pointers stay valid for the life of
+// the process. There are at most kMaxHeaters, one shared-memory slot each.
+static constexpr size_t kMaxHeaters = kStateShmSlots;
+static std::mutex g_heaters_mutex;
+static std::vector<std::unique_ptr<Heater>> g_heaters;
+
+static Heater *find_heater(uint32_t addr) {
+    if (addr == 0) return nullptr;
+    std::lock_guard<std::mutex> lock(g_heaters_mutex);
+    for (auto &h : g_heaters)
+        if (h->addr.load(std::memory_order_relaxed) == addr) return h.get();
+    return nullptr;
+}
+
+// Delta publishing policy, from the environment
+static DeltaPolicy g_delta_policy;
+
+// Live state for local readers (STATE_SHM)
+static StateShmWriter g_state_shm;
+
+// The radio, for its thread-safe frequency offset accessors
+static DieselHeaterRF *g_chip = nullptr;
+
+// Packet capture (CAPTURE_FILE), which also records each publishing batch
+static CaptureWriter *g_capture = nullptr;
+
+// One history file per address in multi-heater mode, like the topic trees;
+// in single-heater mode history.bin belongs to the paired heater.
+static std::string history_path(uint32_t addr, bool multi) {
+    char name[32];
+    if (multi) std::snprintf(name, sizeof(name), "/history_%08x.bin", addr);
+    else std::snprintf(name, sizeof(name), "/history.bin");
+    return g_history_dir + name;
+}
+
+static void open_history(Heater &h, const std::string &path) {
+    std::string error;
+    if (h.history.open(path, &error))
+        h.history.setSampleInterval(g_history_sample_s);
+    else
+        std::cerr << "History disabled: " << error << "\n" << std::flush;
+}
+
+// Returns nullptr, refusing the address, once kMaxHeaters are known.
+static Heater *add_heater(uint32_t addr) {
+    std::lock_guard<std::mutex> lock(g_heaters_mutex);
+    if (g_heaters.size() >= kMaxHeaters) {
+        std::cerr << "Heater 0x" << std::hex << addr << std::dec << " refused: already "
+                  << kMaxHeaters << " heaters\n" << std::flush;
+        return nullptr;
+    }
+    g_heaters.push_back(std::make_unique<Heater>(addr, heater_topics(BASE, addr, g_multi)));
+    Heater *h = g_heaters.back().get();
+    h->shm_slot = g_heaters.size() - 1;
+    g_delta_policy.apply(h->delta);
+    if (g_history) open_history(*h, history_path(addr, g_multi));
+    return h;
+}
+
+// Copy up to cap heater pointers into out without allocating.
+static size_t heater_snapshot(Heater **out, size_t cap) {
+    std::lock_guard<std::mutex> lock(g_heaters_mutex);
+    size_t n = 0;
+    for (auto &h : g_heaters) {
+        if (n == cap) break;
+        out[n++] = h.get();
+    }
+    return n;
+}
+
+static std::vector<Heater *> heater_list() {
+    std::lock_guard<std::mutex> lock(g_heaters_mutex);
+    std::vector<Heater *> out;
+    for (auto &h : g_heaters) out.push_back(h.get());
+    return out;
+}
+
+static void remember_state(Heater &heater, const heater_state_t &st) {
+    std::lock_guard<std::mutex> lock(heater.seen_mutex);
+    heater.seen      = st;
+    heater.have_seen = true;
+}
+
+static uint64_t wall_clock_us() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// Run fn on the event loop if there is one, else right here.
+static void on_loop(std::function<void()> fn) {
+    if (g_loop) g_loop->post(std::move(fn));
+    else fn();
+}
 
 // ---- CC1101 SPI sanity checks ----
 //
@@ -78,53 +233,129 @@ static const std::string DISC_RSSI    = "homeassistant/sensor/diesel_heater/rssi
 // They are used only by cc1101_startup_check(), which runs before the
 // DieselHeaterRF object is initialised.
 
-static void cc1101_spi_transaction(const uint8_t *tx, uint8_t *rx, size_t len) {
-    digitalWritePi(HEATER_SS_PIN, PI_LOW);
-    while (digitalReadPi(HEATER_MISO_PIN)) {} // Wait for CHIP_RDYn
-    g_spi.transfer_buf(tx, rx, len);
-    digitalWritePi(HEATER_SS_PIN, PI_HIGH);
-}
-
-static uint8_t cc1101_read_config_reg(uint8_t addr) {
+static uint8_t cc1101_read_config_reg(CC1101Transport &spi, uint8_t addr) {
     uint8_t tx[2] = { static_cast<uint8_t>(0x80 | (addr & 0x3F)), 0x00 };
     uint8_t rx[2] = {};
-    cc1101_spi_transaction(tx, rx, 2);
+    spi.transfer(tx, rx, 2);
     return rx[1];
 }
 
-static uint8_t cc1101_read_status_reg(uint8_t addr) {
+static uint8_t cc1101_read_status_reg(CC1101Transport &spi, uint8_t addr) {
     uint8_t tx[2] = { static_cast<uint8_t>(0xC0 | (addr & 0x3F)), 0x00 };
     uint8_t rx[2] = {};
-    cc1101_spi_transaction(tx, rx, 2);
+    spi.transfer(tx, rx, 2);
     return rx[1];
 }
 
-static void cc1101_write_reg(uint8_t addr, uint8_t value) {
+static void cc1101_write_reg(CC1101Transport &spi, uint8_t addr, uint8_t value) {
     uint8_t tx[2] = { static_cast<uint8_t>(addr & 0x3F), value };
     uint8_t rx[2];
-    cc1101_spi_transaction(tx, rx, 2);
+    spi.transfer(tx, rx, 2);
+}
+
+static void cc1101_write_burst(CC1101Transport &spi, uint8_t addr, const uint8_t *data, uint8_t len) {
+    uint8_t tx[16] = { static_cast<uint8_t>(0x40 | (addr & 0x3F)) };
+    uint8_t rx[16];
+    std::memcpy(tx + 1, data, len);
+    spi.transfer(tx, rx, size_t(len) + 1);
+}
+
+static void cc1101_read_burst(CC1101Transport &spi, uint8_t addr, uint8_t *data, uint8_t len) {
+    uint8_t tx[16] = { static_cast<uint8_t>(0xC0 | (addr & 0x3F)) };
+    uint8_t rx[16];
+    spi.transfer(tx, rx, size_t(len) + 1);
+    std::memcpy(data, rx + 1, len);
 }
 
-static void cc1101_sres() {
+// Reset, then poll MARCSTATE until the chip is back in IDLE (bounded at 10 ms).
+static void cc1101_sres(CC1101Transport &spi) {
     uint8_t tx[1] = { 0x30 };
     uint8_t rx[1];
-    cc1101_spi_transaction(tx, rx, 1);
-    delay(5);
+    spi.transfer(tx, rx, 1);
+    uint32_t start = micros();
+    while ((cc1101_read_status_reg(spi, 0x35) & 0x1F) != 0x01 && micros() - start < 10000) {}
+}
+
+// Take the chip out of RX or WOR sleep without resetting it.
+static void cc1101_sidle(CC1101Transport &spi) {
+    uint8_t tx[1] = { 0x36 };
+    uint8_t rx[1];
+    spi.transfer(tx, rx, 1);
+    uint32_t start = micros();
+    while ((cc1101_read_status_reg(spi, 0x35) & 0x1F) != 0x01 && micros() - start < 2000) {}
+}
+
+// SPI clocks tried by cc1101_calibrate_spi(), slowest first. The CC1101
+// takes up to 10 MHz, but only 6.5 MHz for burst access.
+static const uint32_t kSpiClocks[] = { 250000, 500000, 1000000, 2000000, 4000000, 5000000, 6500000 };
+
+// One calibration round at the current clock, with the chip idle. PARTNUM
+// and VERSION must read as they did at the base clock. Patterns written to
+// the scratch registers ADDR and CHANNR (address filtering is off), and as a
+// burst to the 8-byte PATABLE, must read back unchanged.
+static bool cc1101_spi_round(CC1101Transport &spi, uint8_t partnum, uint8_t version, unsigned round) {
+    static const uint8_t kPatterns[8] = { 0x00, 0xFF, 0x55, 0xAA, 0x0F, 0xF0, 0x69, 0x96 };
+    if (cc1101_read_status_reg(spi, 0x30) != partnum || cc1101_read_status_reg(spi, 0x31) != version)
+        return false;
+
+    uint8_t a = kPatterns[round % 8], b = kPatterns[(round + 3) % 8];
+    cc1101_write_reg(spi, 0x09, a); // ADDR
+    cc1101_write_reg(spi, 0x0A, b); // CHANNR
+    if (cc1101_read_config_reg(spi, 0x09) != a || cc1101_read_config_reg(spi, 0x0A) != b)
+        return false;
+
+    uint8_t pa[8], back[8];
+    for (unsigned i = 0; i < 8; i++) pa[i] = kPatterns[(round + i) % 8] ^ uint8_t(i);
+    cc1101_write_burst(spi, 0x3E, pa, 8);
+    cc1101_read_burst(spi, 0x3E, back, 8);
+    return std::memcmp(pa, back, 8) == 0;
 }
 
-bool cc1101_startup_check() {
-    pinModePi(HEATER_SS_PIN,   PI_OUTPUT);
-    pinModePi(HEATER_MISO_PIN, PI_INPUT);
-    digitalWritePi(HEATER_SS_PIN, PI_HIGH);
-    delay(1);
+// Step the clock up through kSpiClocks while every round passes at it, then
+// settle one step below the fastest clean clock as margin. The scratch
+// registers are restored at the clock chosen, which is returned.
+static uint32_t cc1101_calibrate_spi(CC1101Transport &spi, uint8_t partnum, uint8_t version,
+                                     uint32_t *fastest) {
+    static constexpr unsigned kRounds = 64;
+    uint8_t addr   = cc1101_read_config_reg(spi, 0x09);
+    uint8_t channr = cc1101_read_config_reg(spi, 0x0A);
+    uint8_t pa[8];
+    cc1101_read_burst(spi, 0x3E, pa, 8);
+
+    size_t good = 0;
+    for (size_t i = 0; i < sizeof(kSpiClocks) / sizeof(kSpiClocks[0]); i++) {
+        spi.setSpeed(kSpiClocks[i]);
+        bool ok = true;
+        for (unsigned r = 0; r < kRounds && ok; r++) ok = cc1101_spi_round(spi, partnum, version, r);
+        if (!ok) break;
+        good = i;
+    }
+    *fastest = kSpiClocks[good];
+    uint32_t chosen = kSpiClocks[good > 0 ? good - 1 : 0];
+    spi.setSpeed(chosen);
+
+    cc1101_write_reg(spi, 0x09, addr);
+    cc1101_write_reg(spi, 0x0A, channr);
+    cc1101_write_burst(spi, 0x3E, pa, 8);
+    return chosen;
+}
+
+// Without reset, the chip keeps its configuration for DieselHeaterRF::begin()
+// to reuse (warm restart). The SPI clock is then calibrated (calibrate), set
+// to spi_speed_hz, or, if 0, left at HEATER_SPI_SPEED_HZ.
+bool cc1101_startup_check(CC1101Transport &spi, bool reset, uint32_t spi_speed_hz,
+                          bool calibrate) {
     try {
-        cc1101_sres();
+        spi.begin();
+        delay(1);
+        if (reset) cc1101_sres(spi);
+        else cc1101_sidle(spi);
 
-        uint8_t partnum    = cc1101_read_status_reg(0x30); // PARTNUM
-        uint8_t version    = cc1101_read_status_reg(0x31); // VERSION
-        uint8_t freq2_init = cc1101_read_config_reg(0x0D); // FREQ2 before write
-        cc1101_write_reg(0x0D, 0x10);
-        uint8_t freq2_set  = cc1101_read_config_reg(0x0D); // FREQ2 after write
+        uint8_t partnum    = cc1101_read_status_reg(spi, 0x30); // PARTNUM
+        uint8_t version    = cc1101_read_status_reg(spi, 0x31); // VERSION
+        uint8_t freq2_init = cc1101_read_config_reg(spi, 0x0D); // FREQ2 before write
+        cc1101_write_reg(spi, 0x0D, 0x10);
+        uint8_t freq2_set  = cc1101_read_config_reg(spi, 0x0D); // FREQ2 after write
 
         std::cout << "CC1101 PARTNUM=0x"      << std::hex << int(partnum)
                   << " VERSION=0x"            << std::hex << int(version)
@@ -139,6 +370,24 @@ bool cc1101_startup_check() {
                       << " VERSION=0x" << int(version) << ")\n" << std::dec;
             return false;
         }
+
+        static Gauge &spi_clock = metrics().gauge("cc1101_spi_clock_hz", "SPI clock used with the CC1101");
+        if (calibrate) {
+            if (spi.speed()) {
+                uint32_t start = millis(), fastest = 0;
+                uint32_t chosen = cc1101_calibrate_spi(spi, partnum, version, &fastest);
+                std::cout << "SPI clock " << chosen << " Hz (calibrated: clean up to " << fastest
+                          << " Hz, " << millis() - start << " ms)\n";
+            }
+        } else if (spi_speed_hz) {
+            if (spi.setSpeed(spi_speed_hz)) {
+                std::cout << "SPI clock " << spi_speed_hz << " Hz (SPI_SPEED_HZ)";
+                if (!cc1101_spi_round(spi, partnum, version, 0))
+                    std::cout << ", read-back errors at this clock";
+                std::cout << "\n";
+            }
+        }
+        spi_clock.set(spi.speed());
         return true;
     } catch (const std::exception &e) {
         std::cerr << "CC1101 SPI error: " << e.what() << "\n";
@@ -162,81 +411,86 @@ int get_env_int_or(const char *name, int fallback) {
     }
 }
 
-// Helper: load/save heater address
-uint32_t load_address() {
-    std::ifstream f(ADDR_FILE);
-    if (!f) return 0;
-    uint32_t addr = 0;
-    f >> std::hex >> addr;
-    return addr;
+// Helper: load/save heater addresses (one hex address per line)
+std::vector<uint32_t> load_addresses() {
+    return load_address_file(ADDR_FILE, g_multi);
 }
 
-void save_address(uint32_t addr) {
+void save_addresses() {
     std::ofstream f(ADDR_FILE, std::ios::trunc);
     if (!f) return;
-    f << std::hex << addr;
+    for (Heater *h : heater_list()) {
+        uint32_t addr = h->addr.load(std::memory_order_relaxed);
+        if (addr != 0) f << std::hex << addr << "\n";
+    }
+}
+
+// Learned frequency offsets, one "<hex address> <FSCTRL0 steps>" per line
+void load_freq_offsets(DieselHeaterRF &chip) {
+    std::ifstream f(FREQ_FILE);
+    uint32_t addr = 0;
+    float steps = 0;
+    while (f >> std::hex >> addr >> std::dec >> steps)
+        if (addr != 0) chip.setFreqOffset(addr, steps);
+}
+
+void save_freq_offsets() {
+    std::ofstream f(FREQ_FILE, std::ios::trunc);
+    if (!f || !g_chip) return;
+    for (Heater *h : heater_list()) {
+        uint32_t addr = h->addr.load(std::memory_order_relaxed);
+        float steps;
+        if (addr == 0 || !g_chip->freqOffset(addr, &steps)) continue;
+        char line[32];
+        std::snprintf(line, sizeof(line), "%08x %.2f\n", addr, steps);
+        f << line;
+    }
 }
 
 // MQTT publish helper
 void mqtt_publish(struct mosquitto *mosq, const std::string &topic,
-                  const std::string &payload, bool retain = false) {
-    mosquitto_publish(mosq, nullptr, topic.c_str(),
-                      (int)payload.size(), payload.data(), 0,
-                      retain ? 1 : 0);
-}
-
-// Decode numeric state to text
-std::string heater_state_to_str(uint8_t code) {
-    switch (code) {
-        case HEATER_STATE_OFF:           return "off";
-        case HEATER_STATE_STARTUP:       return "startup";
-        case HEATER_STATE_WARMING:       return "warming";
-        case HEATER_STATE_WARMING_WAIT:  return "warming_wait";
-        case HEATER_STATE_PRE_RUN:       return "pre_run";
-        case HEATER_STATE_RUNNING:       return "running";
-        case HEATER_STATE_SHUTDOWN:      return "shutdown";
-        case HEATER_STATE_SHUTTING_DOWN: return "shutting_down";
-        case HEATER_STATE_COOLING:       return "cooling";
-        default:                         return "unknown";
-    }
-}
-
-bool heater_is_on(uint8_t state_code) {
-    switch (state_code) {
-        case HEATER_STATE_OFF:
-            return false;
-        case HEATER_STATE_SHUTDOWN:
-        case HEATER_STATE_SHUTTING_DOWN:
-        case HEATER_STATE_COOLING:
-            return false;
-        case HEATER_STATE_STARTUP:
-        case HEATER_STATE_WARMING:
-        case HEATER_STATE_WARMING_WAIT:
-        case HEATER_STATE_PRE_RUN:
-        case HEATER_STATE_RUNNING:
-            return true;
-        default:
-            return false;
+                  const char *payload, size_t len, bool retain = false) {
+    static Histogram &duration = metrics().histogram(
+        "mqtt_publish_duration_seconds", "Time spent in mosquitto_publish");
+    static Counter &errors = metrics().counter(
+        "mqtt_publish_errors_total", "mosquitto_publish calls that failed");
+    int rc;
+    {
+        ScopedTimer t(duration);
+        rc = mosquitto_publish(mosq, nullptr, topic.c_str(),
+                               (int)len, payload, 0,
+                               retain ? 1 : 0);
     }
+    if (rc != MOSQ_ERR_SUCCESS) errors.inc();
+    // Output left queued (from another thread, or a full socket) needs the
+    // event loop to watch for writability.
+    if (g_loop && mosquitto_want_write(mosq)) g_loop->wake();
 }
 
-void publish_discovery(struct mosquitto *mosq) {
-    // Common device JSON fragment
-    const std::string device_json =
-        R"("device":{"identifiers":["diesel_heater"],)"
-        R"("name":"Diesel Heater",)"
-        R"("manufacturer":"Generic",)"
-        R"("model":"CC1101 RF Bridge"})";
+void mqtt_publish(struct mosquitto *mosq, const std::string &topic,
+                  const std::string &payload, bool retain = false) {
+    mqtt_publish(mosq, topic, payload.data(), payload.size(), retain);
+}
 
-    // Power switch
-    mqtt_publish(mosq, DISC_POWER,
-        R"({"name":"Diesel Heater Power","unique_id":"diesel_heater_power",)"
-        R"("command_topic":")" + T_POWER_C +
-        R"(","state_topic":")" + T_POWER_S +
-        R"(","availability_topic":")" + T_AVAIL +
-        R"(","icon":"mdi:fire",)" +
-        device_json + "}", true);
+void mqtt_publish(struct mosquitto *mosq, const std::string &topic,
+                  const char *payload, bool retain = false) {
+    mqtt_publish(mosq, topic, payload, std::strlen(payload), retain);
+}
+
+void mqtt_publish(struct mosquitto *mosq, const std::string &topic,
+                  const PayloadBuffer &payload, bool retain = false) {
+    mqtt_publish(mosq, topic, payload.data(), payload.size(), retain);
+}
+
+// Common device JSON fragment for one heater (or the bridge itself)
+static std::string device_json(const std::string &id, const std::string &name) {
+    return R"("device":{"identifiers":[")" + id + R"("],)"
+           R"("name":")" + name + R"(",)"
+           R"("manufacturer":"Generic",)"
+           R"("model":"CC1101 RF Bridge"})";
+}
 
+void publish_bridge_discovery(struct mosquitto *mosq) {
     // Pairing switch
     mqtt_publish(mosq, DISC_PAIR,
         R"({"name":"Diesel Heater Pair","unique_id":"diesel_heater_pair",)"
@@ -244,146 +498,592 @@ void publish_discovery(struct mosquitto *mosq) {
         R"(","state_topic":")" + T_PAIR_S +
         R"(","availability_topic":")" + T_AVAIL +
         R"(","icon":"mdi:link",)" +
-        device_json + "}", true);
+        device_json("diesel_heater", "Diesel Heater") + "}", true);
+
+    if (!g_streaming) return;
+
+    // Receive mode select
+    mqtt_publish(mosq, DISC_RXMODE,
+        R"({"name":"Diesel Heater RX Mode","unique_id":"diesel_heater_rx_mode",)"
+        R"("command_topic":")" + T_RXMODE_C +
+        R"(","state_topic":")" + T_RXMODE_S +
+        R"(","availability_topic":")" + T_AVAIL +
+        R"(","options":["continuous","wor"],)"
+        R"("icon":"mdi:radio-tower",)" +
+        device_json("diesel_heater", "Diesel Heater") + "}", true);
+
+    // Frames caught per minute, relative to continuous RX
+    mqtt_publish(mosq, DISC_CAPTURE,
+        R"({"name":"Diesel Heater RX Capture Rate","unique_id":"diesel_heater_rx_capture",)"
+        R"("state_topic":")" + T_CAPTURE +
+        R"(","availability_topic":")" + T_AVAIL +
+        R"(","value_template":"{{ (value_json.capture_rate * 100) | round(1) if value_json.capture_rate is not none else none }}",)"
+        R"("unit_of_measurement":"%","icon":"mdi:percent",)" +
+        device_json("diesel_heater", "Diesel Heater") + "}", true);
+}
+
+void publish_discovery(struct mosquitto *mosq, const HeaterTopics &t) {
+    const std::string device = device_json(t.id, t.name);
+
+    // Power switch
+    mqtt_publish(mosq, t.disc_power,
+        R"({"name":")" + t.name + R"( Power","unique_id":")" + t.id + R"(_power",)"
+        R"("command_topic":")" + t.power_c +
+        R"(","state_topic":")" + t.power_s +
+        R"(","availability_topic":")" + T_AVAIL +
+        R"(","icon":"mdi:fire",)" +
+        device + "}", true);
 
     // Mode select
-    mqtt_publish(mosq, DISC_MODE,
-        R"({"name":"Diesel Heater Mode","unique_id":"diesel_heater_mode",)"
-        R"("command_topic":")" + T_MODE_C +
-        R"(","state_topic":")" + T_MODE_S +
+    mqtt_publish(mosq, t.disc_mode,
+        R"({"name":")" + t.name + R"( Mode","unique_id":")" + t.id + R"(_mode",)"
+        R"("command_topic":")" + t.mode_c +
+        R"(","state_topic":")" + t.mode_s +
         R"(","availability_topic":")" + T_AVAIL +
         R"(","options":["auto","manual"],)"
         R"("icon":"mdi:thermostat",)" +
-        device_json + "}", true);
+        device + "}", true);
 
     // Ambient temperature
-    mqtt_publish(mosq, DISC_TEMP,
-        R"({"name":"Diesel Heater Ambient Temperature","unique_id":"diesel_heater_ambient_temp",)"
-        R"("state_topic":")" + T_TEMP +
+    mqtt_publish(mosq, t.disc_temp,
+        R"({"name":")" + t.name + R"( Ambient Temperature","unique_id":")" + t.id + R"(_ambient_temp",)"
+        R"("state_topic":")" + t.temp +
         R"(","availability_topic":")" + T_AVAIL +
         R"(","unit_of_measurement":"°C","device_class":"temperature","state_class":"measurement",)"
         R"("icon":"mdi:thermometer",)" +
-        device_json + "}", true);
+        device + "}", true);
 
     // Voltage
-    mqtt_publish(mosq, DISC_VOLT,
-        R"({"name":"Diesel Heater Voltage","unique_id":"diesel_heater_voltage",)"
-        R"("state_topic":")" + T_VOLT +
+    mqtt_publish(mosq, t.disc_volt,
+        R"({"name":")" + t.name + R"( Voltage","unique_id":")" + t.id + R"(_voltage",)"
+        R"("state_topic":")" + t.volt +
         R"(","availability_topic":")" + T_AVAIL +
         R"(","unit_of_measurement":"V","device_class":"voltage","state_class":"measurement",)"
         R"("icon":"mdi:current-dc",)" +
-        device_json + "}", true);
+        device + "}", true);
 
     // Case temp
-    mqtt_publish(mosq, DISC_CASE,
-        R"({"name":"Diesel Heater Case Temperature","unique_id":"diesel_heater_case_temp",)"
-        R"("state_topic":")" + T_CASE +
+    mqtt_publish(mosq, t.disc_case,
+        R"({"name":")" + t.name + R"( Case Temperature","unique_id":")" + t.id + R"(_case_temp",)"
+        R"("state_topic":")" + t.case_temp +
         R"(","availability_topic":")" + T_AVAIL +
         R"(","unit_of_measurement":"°C","device_class":"temperature","state_class":"measurement",)"
         R"("icon":"mdi:thermometer-lines",)" +
-        device_json + "}", true);
+        device + "}", true);
 
     // Pump frequency
-    mqtt_publish(mosq, DISC_PFREQ,
-        R"({"name":"Diesel Heater Pump Frequency","unique_id":"diesel_heater_pump_freq",)"
-        R"("state_topic":")" + T_PFREQ +
+    mqtt_publish(mosq, t.disc_pfreq,
+        R"({"name":")" + t.name + R"( Pump Frequency","unique_id":")" + t.id + R"(_pump_freq",)"
+        R"("state_topic":")" + t.pfreq +
         R"(","availability_topic":")" + T_AVAIL +
         R"(","unit_of_measurement":"Hz","state_class":"measurement",)"
         R"("icon":"mdi:pulse",)" +
-        device_json + "}", true);
+        device + "}", true);
 
     // Heater state (numeric)
-    mqtt_publish(mosq, DISC_HSTATE,
-        R"({"name":"Diesel Heater State Code","unique_id":"diesel_heater_state_code",)"
-        R"("state_topic":")" + T_HSTATE +
+    mqtt_publish(mosq, t.disc_hstate,
+        R"({"name":")" + t.name + R"( State Code","unique_id":")" + t.id + R"(_state_code",)"
+        R"("state_topic":")" + t.hstate +
         R"(","availability_topic":")" + T_AVAIL +
         R"(","icon":"mdi:numeric",)" +
-        device_json + "}", true);
+        device + "}", true);
 
     // Heater state (text)
-    mqtt_publish(mosq, DISC_HTEXT,
-        R"({"name":"Diesel Heater State","unique_id":"diesel_heater_state_text",)"
-        R"("state_topic":")" + T_HSTATE_TXT +
+    mqtt_publish(mosq, t.disc_htext,
+        R"({"name":")" + t.name + R"( State","unique_id":")" + t.id + R"(_state_text",)"
+        R"("state_topic":")" + t.hstate_txt +
         R"(","availability_topic":")" + T_AVAIL +
         R"(","icon":"mdi:information",)" +
-        device_json + "}", true);
+        device + "}", true);
 
     // RSSI
-    mqtt_publish(mosq, DISC_RSSI,
-        R"({"name":"RSSI","unique_id":"diesel_heater_rssi",)"
-        R"("state_topic":")" + T_RSSI +
+    mqtt_publish(mosq, t.disc_rssi,
+        R"({"name":")" + std::string(g_multi ? t.name + " RSSI" : "RSSI") +
+        R"(","unique_id":")" + t.id + R"(_rssi",)"
+        R"("state_topic":")" + t.rssi +
         R"(","availability_topic":")" + T_AVAIL +
         R"(","unit_of_measurement":"dBm","device_class":"signal_strength","state_class":"measurement",)"
         R"("icon":"mdi:signal",)" +
-        device_json + "}", true);
+        device + "}", true);
+
+    // Setpoint (auto mode)
+    mqtt_publish(mosq, t.disc_setpoint,
+        R"({"name":")" + t.name + R"( Setpoint","unique_id":")" + t.id + R"(_setpoint",)"
+        R"("command_topic":")" + t.setpoint_c +
+        R"(","state_topic":")" + t.setpoint +
+        R"(","availability_topic":")" + T_AVAIL +
+        R"(","min":)" + std::to_string(HEATER_SETPOINT_MIN) +
+        R"(,"max":)" + std::to_string(HEATER_SETPOINT_MAX) +
+        R"(,"step":1,"unit_of_measurement":"°C","mode":"box",)"
+        R"("icon":"mdi:thermometer",)" +
+        device + "}", true);
+
+    // Pump frequency target (manual mode)
+    mqtt_publish(mosq, t.disc_pfreq_set,
+        R"({"name":")" + t.name + R"( Pump Frequency Target","unique_id":")" + t.id + R"(_pump_freq_set",)"
+        R"("command_topic":")" + t.pfreq_c +
+        R"(","state_topic":")" + t.pfreq +
+        R"(","availability_topic":")" + T_AVAIL +
+        R"(","min":1.0,"max":5.5,"step":0.1,"unit_of_measurement":"Hz","mode":"box",)"
+        R"("icon":"mdi:pulse",)" +
+        device + "}", true);
+
+    // Radio link quality
+    mqtt_publish(mosq, t.disc_freq_offset,
+        R"({"name":")" + t.name + R"( Frequency Offset","unique_id":")" + t.id + R"(_freq_offset",)"
+        R"("state_topic":")" + t.rx_quality +
+        R"(","availability_topic":")" + T_AVAIL +
+        R"(","value_template":"{{ value_json.freq_offset_khz }}",)"
+        R"("unit_of_measurement":"kHz","state_class":"measurement","entity_category":"diagnostic",)"
+        R"("icon":"mdi:sine-wave",)" +
+        device + "}", true);
+    mqtt_publish(mosq, t.disc_rx_success,
+        R"({"name":")" + t.name + R"( Packet Success Rate","unique_id":")" + t.id + R"(_rx_success",)"
+        R"("state_topic":")" + t.rx_quality +
+        R"(","availability_topic":")" + T_AVAIL +
+        R"(","value_template":"{{ (value_json.success_rate * 100) | round(1) if value_json.success_rate is not none else none }}",)"
+        R"("unit_of_measurement":"%","state_class":"measurement","entity_category":"diagnostic",)"
+        R"("icon":"mdi:percent",)" +
+        device + "}", true);
 }
 
-// Handle MQTT commands → RF commands and pairing
-void handle_command(DieselHeaterRF &heater,
-                    const std::string &topic,
-                    const std::string &payload,
-                    struct mosquitto *mosq,
-                    uint32_t &heater_addr) {
+// Subscribe to one heater's command topics
+void subscribe_heater(struct mosquitto *mosq, const HeaterTopics &t) {
+    mosquitto_subscribe(mosq, nullptr, t.history_get.c_str(), 0);
+    mosquitto_subscribe(mosq, nullptr, t.power_c.c_str(), 0);
+    mosquitto_subscribe(mosq, nullptr, t.mode_c.c_str(), 0);
+    mosquitto_subscribe(mosq, nullptr, t.setpoint_c.c_str(), 0);
+    mosquitto_subscribe(mosq, nullptr, t.pfreq_c.c_str(), 0);
+    mosquitto_subscribe(mosq, nullptr, t.cmd_wakeup.c_str(), 0);
+    mosquitto_subscribe(mosq, nullptr, t.cmd_mode.c_str(), 0);
+    mosquitto_subscribe(mosq, nullptr, t.cmd_power.c_str(), 0);
+    mosquitto_subscribe(mosq, nullptr, t.cmd_up.c_str(), 0);
+    mosquitto_subscribe(mosq, nullptr, t.cmd_down.c_str(), 0);
+}
 
-    std::cout << "Received command: " << topic << ", with payload: " << payload << "\n" << std::flush;
-    if (topic == T_POWER_C) {
-        if (heater_addr == 0) return;
+// Single-heater re-pairing: the one table entry now stands for another
+// heater, so nothing learned from the old one carries over. The old heater's
+// history is set aside as history_<address>.bin, and the new one's is taken
+// back from there if it was paired before. Runs where pairing completes: the
+// state thread or event loop, or the radio thread while state_loop is parked
+// by g_pairing.
+static void repoint_heater(Heater &heater, uint32_t addr) {
+    uint32_t old = heater.addr.exchange(addr);
+    if (old == addr) return;
+    heater.delta.invalidate();
+    heater.pending        = PendingState{};
+    heater.quality_frames = 0;
+    heater.offset_saved   = false;
+    heater.last_state_code.store(HEATER_STATE_OFF, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(heater.seen_mutex);
+        heater.seen      = heater_state_t{};
+        heater.have_seen = false;
+    }
+    if (g_state_shm.isOpen()) g_state_shm.reset(heater.shm_slot, addr);
+    if (heater.history.isOpen()) {
+        std::string path = history_path(addr, false);
+        heater.history.close();
+        std::rename(path.c_str(), history_path(old, true).c_str());
+        std::rename(history_path(addr, true).c_str(), path.c_str());
+        open_history(heater, path);
+    }
+}
+
+// Record a newly paired address: a new table entry in multi-heater mode, or
+// the replacement address in single-heater mode.
+void register_paired(RadioWorker &radio, struct mosquitto *mosq, uint32_t addr) {
+    if (g_multi) {
+        if (find_heater(addr)) return;
+        Heater *h = add_heater(addr);
+        if (!h) return;
+        subscribe_heater(mosq, h->topics);
+        publish_discovery(mosq, h->topics);
+    } else {
+        std::vector<Heater *> heaters = heater_list();
+        if (heaters.empty()) {
+            Heater *h = add_heater(addr);
+            subscribe_heater(mosq, h->topics);
+            publish_discovery(mosq, h->topics);
+        } else {
+            repoint_heater(*heaters[0], addr);
+        }
+        radio.setAddress(addr);
+    }
+    save_addresses();
+}
+
+using StateCheck = std::function<bool(const heater_state_t &)>;
+
+static const char *command_name(uint8_t cmd) {
+    switch (cmd) {
+        case HEATER_CMD_WAKEUP: return "wakeup";
+        case HEATER_CMD_MODE:   return "mode";
+        case HEATER_CMD_POWER:  return "power";
+        case HEATER_CMD_UP:     return "up";
+        case HEATER_CMD_DOWN:   return "down";
+        default:                return "unknown";
+    }
+}
+
+// What a status packet must show for cmd to have taken effect, judged
+// against the last state heard. Without a baseline any reply counts.
+static StateCheck expect_change(Heater &heater, uint8_t cmd) {
+    heater_state_t before;
+    {
+        std::lock_guard<std::mutex> lock(heater.seen_mutex);
+        if (!heater.have_seen) return [](const heater_state_t &) { return true; };
+        before = heater.seen;
+    }
+    switch (cmd) {
+        case HEATER_CMD_POWER: {
+            bool was_on = heater_is_on(before.state);
+            return [was_on](const heater_state_t &st) { return heater_is_on(st.state) != was_on; };
+        }
+        case HEATER_CMD_MODE:
+            return [before](const heater_state_t &st) { return st.autoMode != before.autoMode; };
+        case HEATER_CMD_UP:
+            return [before](const heater_state_t &st) {
+                return before.autoMode ? st.setpoint > before.setpoint : st.pumpFreq > before.pumpFreq;
+            };
+        case HEATER_CMD_DOWN:
+            return [before](const heater_state_t &st) {
+                return before.autoMode ? st.setpoint < before.setpoint : st.pumpFreq < before.pumpFreq;
+            };
+        default:
+            return [](const heater_state_t &) { return true; };
+    }
+}
+
+// cmd/result "result" of an acknowledged send
+static const char *ack_result(const heater_ack_t &r) {
+    if (r.delivered) return "delivered";
+    return r.txFailed ? "tx_failed" : "failed";
+}
+
+// Send cmd to heater. With acknowledged sends, repeats stop as soon as a
+// status packet passes expect, and the outcome is published on cmd/result.
+static void send_heater_command(RadioWorker &radio, Heater &heater, uint8_t cmd,
+                                StateCheck expect, struct mosquitto *mosq) {
+    uint32_t addr = heater.addr.load(std::memory_order_relaxed);
+    if (!g_ack_commands) {
+        radio.sendCommand(cmd, addr);
+        return;
+    }
+    Heater *h = &heater;
+    radio.sendCommandAcked(cmd, addr, std::move(expect), [h, cmd, mosq](const heater_ack_t &r) {
+        on_loop([h, cmd, mosq, r] {
+            if (r.heard) remember_state(*h, r.state);
+            PayloadBuffer buf;
+            buf.append("{\"command\":\"").append(command_name(cmd))
+               .append("\",\"result\":\"").append(ack_result(r))
+               .append("\",\"attempts\":").appendInt(r.bursts)
+               .append(",\"frames\":").appendInt(r.frames)
+               .append(",\"ms\":").appendInt(r.elapsedMs)
+               .append("}");
+            mqtt_publish(mosq, h->topics.cmd_result, buf);
+        });
+    });
+}
+
+static void send_heater_command(RadioWorker &radio, Heater &heater, uint8_t cmd,
+                                struct mosquitto *mosq) {
+    send_heater_command(radio, heater, cmd, expect_change(heater, cmd), mosq);
+}
 
+// Setpoint (degC) or pump frequency (0.1 Hz) as whole UP/DOWN steps.
+static int target_steps(const heater_state_t &st, bool setpoint) {
+    return setpoint ? st.setpoint : (int)std::lround(st.pumpFreq * 10.0f);
+}
+
+static void publish_target_result(struct mosquitto *mosq, Heater &heater, bool setpoint,
+                                  int target, const char *result, int rounds,
+                                  uint32_t frames, uint32_t started_ms) {
+    PayloadBuffer buf;
+    buf.append("{\"command\":\"").append(setpoint ? "setpoint" : "pump_freq")
+       .append("\",\"target\":");
+    if (setpoint) buf.appendInt(target);
+    else buf.appendFixed(target / 10.0, 1);
+    buf.append(",\"result\":\"").append(result)
+       .append("\",\"attempts\":").appendInt(rounds)
+       .append(",\"frames\":").appendInt(frames)
+       .append(",\"ms\":").appendInt(millis() - started_ms)
+       .append("}");
+    mqtt_publish(mosq, heater.topics.cmd_result, buf);
+}
+
+// Drive the setpoint (auto mode) or pump frequency (manual mode) to target:
+// the UP/DOWN steps counted from the last state heard go out as one
+// pipelined sequence, checked against the next status packet. A status
+// short of the target (steps lost on air) resumes from there, for up to
+// three rounds. Returns false if the request was refused outright.
+static bool drive_target(RadioWorker &radio, Heater &heater, bool setpoint, int target,
+                         struct mosquitto *mosq, int round = 1, uint32_t frames = 0,
+                         uint32_t started_ms = millis()) {
+    heater_state_t now;
+    {
+        std::lock_guard<std::mutex> lock(heater.seen_mutex);
+        if (!heater.have_seen) {
+            publish_target_result(mosq, heater, setpoint, target, "no_state", round - 1, frames, started_ms);
+            return false;
+        }
+        now = heater.seen;
+    }
+    if (bool(now.autoMode) != setpoint) {
+        // UP/DOWN would move the other quantity
+        publish_target_result(mosq, heater, setpoint, target, "wrong_mode", round - 1, frames, started_ms);
+        return false;
+    }
+    int diff = target - target_steps(now, setpoint);
+    if (diff == 0) {
+        publish_target_result(mosq, heater, setpoint, target, "delivered", round - 1, frames, started_ms);
+        return true;
+    }
+
+    Heater *h = &heater;
+    RadioWorker *r = &radio;
+    radio.sendSteps(diff > 0 ? HEATER_CMD_UP : HEATER_CMD_DOWN, (uint8_t)std::abs(diff),
+                    h->addr.load(std::memory_order_relaxed),
+                    [setpoint, target](const heater_state_t &st) { return target_steps(st, setpoint) == target; },
+                    [=](const heater_ack_t &ack) { on_loop([=] {
+        if (ack.heard) remember_state(*h, ack.state);
+        if (!ack.delivered && ack.heard && round < 3) {
+            drive_target(*r, *h, setpoint, target, mosq, round + 1, frames + ack.frames, started_ms);
+            return;
+        }
+        publish_target_result(mosq, *h, setpoint, target, ack_result(ack),
+                              round, frames + ack.frames, started_ms);
+    }); });
+    return true;
+}
+
+// Handle one heater's command topics → RF commands addressed to it
+void handle_heater_command(RadioWorker &radio, Heater &heater,
+                           const std::string &topic,
+                           const std::string &payload,
+                           struct mosquitto *mosq) {
+
+    const HeaterTopics &t = heater.topics;
+    uint32_t heater_addr = heater.addr.load(std::memory_order_relaxed);
+    if (heater_addr == 0) return;
+
+    if (topic == t.power_c) {
         std::string desired = payload;
         for (auto &c : desired) c = std::toupper(static_cast<unsigned char>(c));
         bool want_on = (desired == "ON");
         bool want_off = (desired == "OFF");
         if (!want_on && !want_off) return;
 
-        uint8_t current_state = g_last_state_code.load(std::memory_order_relaxed);
+        uint8_t current_state = heater.last_state_code.load(std::memory_order_relaxed);
         bool is_on = heater_is_on(current_state);
 
         if ((want_on && !is_on) || (want_off && is_on)) {
-            heater.sendCommand(HEATER_CMD_POWER);
+            send_heater_command(radio, heater, HEATER_CMD_POWER,
+                [want_on](const heater_state_t &st) { return heater_is_on(st.state) == want_on; }, mosq);
         }
         // Optimistically publish; will be kept in sync by state loop
-        mqtt_publish(mosq, T_POWER_S, want_on ? "ON" : "OFF");
-    } else if (topic == T_CMD_POWER) {
+        mqtt_publish(mosq, t.power_s, want_on ? "ON" : "OFF");
+        heater.delta.invalidate(F_POWER_STATE);
+    } else if (topic == t.setpoint_c || topic == t.pfreq_c) {
+        bool setpoint = topic == t.setpoint_c;
+        char *end = nullptr;
+        double value = std::strtod(payload.c_str(), &end);
+        if (end == payload.c_str()) return;
+        int target = setpoint
+            ? (int)std::lround(std::fmin(std::fmax(value, HEATER_SETPOINT_MIN), HEATER_SETPOINT_MAX))
+            : (int)std::lround(std::fmin(std::fmax(value, HEATER_PUMP_FREQ_MIN), HEATER_PUMP_FREQ_MAX) * 10.0);
+        if (!drive_target(radio, heater, setpoint, target, mosq)) return;
+
+        // Optimistically publish; will be kept in sync by state loop
+        PayloadBuffer buf;
+        if (setpoint) buf.appendInt(target);
+        else buf.appendFixed(target / 10.0);
+        mqtt_publish(mosq, setpoint ? t.setpoint : t.pfreq, buf);
+        heater.delta.invalidate(setpoint ? F_SETPOINT : F_PUMP_FREQ);
+    } else if (topic == t.cmd_power) {
         // raw power toggle, for debugging/advanced use
-        if (heater_addr == 0) return;
-        heater.sendCommand(HEATER_CMD_POWER);
-    } else if (topic == T_CMD_WAKEUP) {
-        if (heater_addr == 0) return;
-        heater.sendCommand(HEATER_CMD_WAKEUP);
-    } else if (topic == T_CMD_MODE) {
-        if (heater_addr == 0) return;
-        heater.sendCommand(HEATER_CMD_MODE);
-    } else if (topic == T_CMD_UP) {
-        if (heater_addr == 0) return;
-        heater.sendCommand(HEATER_CMD_UP);
-    } else if (topic == T_CMD_DOWN) {
-        if (heater_addr == 0) return;
-        heater.sendCommand(HEATER_CMD_DOWN);
-    } else if (topic == T_MODE_C) {
-        if (heater_addr == 0) return;
-        heater.sendCommand(HEATER_CMD_MODE);
+        send_heater_command(radio, heater, HEATER_CMD_POWER, mosq);
+    } else if (topic == t.cmd_wakeup) {
+        send_heater_command(radio, heater, HEATER_CMD_WAKEUP, mosq);
+    } else if (topic == t.cmd_mode) {
+        send_heater_command(radio, heater, HEATER_CMD_MODE, mosq);
+    } else if (topic == t.cmd_up) {
+        send_heater_command(radio, heater, HEATER_CMD_UP, mosq);
+    } else if (topic == t.cmd_down) {
+        send_heater_command(radio, heater, HEATER_CMD_DOWN, mosq);
+    } else if (topic == t.mode_c) {
+        if (payload == "auto" || payload == "manual") {
+            bool want_auto = payload == "auto";
+            send_heater_command(radio, heater, HEATER_CMD_MODE,
+                [want_auto](const heater_state_t &st) { return bool(st.autoMode) == want_auto; }, mosq);
+        } else {
+            send_heater_command(radio, heater, HEATER_CMD_MODE, mosq);
+        }
         if (payload == "auto") {
-            mqtt_publish(mosq, T_MODE_S, "auto");
+            mqtt_publish(mosq, t.mode_s, "auto");
         } else if (payload == "manual") {
-            mqtt_publish(mosq, T_MODE_S, "manual");
+            mqtt_publish(mosq, t.mode_s, "manual");
         }
-    } else if (topic == T_PAIR_C) {
+    }
+}
+
+// Integer value of "key" in a flat JSON object, or fallback.
+static long long json_int(const std::string &json, const char *key, long long fallback) {
+    std::string k = std::string("\"") + key + "\"";
+    size_t pos = json.find(k);
+    if (pos == std::string::npos) return fallback;
+    pos = json.find(':', pos + k.size());
+    if (pos == std::string::npos) return fallback;
+    const char *start = json.c_str() + pos + 1;
+    char *end = nullptr;
+    long long v = std::strtoll(start, &end, 10);
+    return end != start ? v : fallback;
+}
+
+// Answer a history range query on history/result. Payload (all optional):
+// {"from":-86400,"to":0,"step":3600,"points":500}. Times are Unix seconds;
+// zero or negative means relative to now. step is 1 (raw samples), 60 or
+// 3600; omitted, minutes are used for up to a day and hours beyond.
+static void handle_history_query(Heater &heater, const std::string &payload,
+                                 struct mosquitto *mosq) {
+    long long now  = (long long)std::time(nullptr);
+    long long from = json_int(payload, "from", -86400);
+    long long to   = json_int(payload, "to", 0);
+    if (from <= 0) from += now;
+    if (to <= 0) to += now;
+    long long step   = json_int(payload, "step", 0);
+    long long points = json_int(payload, "points", 1440);
+    if (from < 0) from = 0;
+    if (to < from) to = from;
+    if (points <= 0 || points > 10000) points = 1440;
+    mqtt_publish(mosq, heater.topics.history_result,
+                 heater.history.query((uint32_t)from, (uint32_t)to, (uint32_t)(step < 0 ? 0 : step),
+                                      (size_t)points));
+}
+
+// Handle MQTT commands → RF commands and pairing
+// Next frame on reader from a heater that could be paired (in multi-heater
+// mode, one not paired yet), or 0.
+static uint32_t pairing_candidate(HeaterFrameRing::Reader &reader) {
+    heater_frame_t frame;
+    while (reader.pop(frame)) {
+        uint32_t addr = DieselHeaterRF::parseAddress(frame.data);
+        if (!(g_multi && find_heater(addr))) return addr;
+    }
+    return 0;
+}
+
+// Streaming pairing on the event loop: candidates are checked on every frame
+// event, and a one-shot timer ends the search after a minute.
+struct LoopPairing {
+    bool active = false;
+    int  timer  = -1;
+    HeaterFrameRing::Reader reader;
+    std::function<void(uint32_t)> done;
+};
+static LoopPairing g_loop_pairing;
+
+static void finish_loop_pairing(uint32_t addr) {
+    LoopPairing &p = g_loop_pairing;
+    p.active = false;
+    g_loop->setTimer(p.timer, 0);
+    std::function<void(uint32_t)> done = std::move(p.done);
+    done(addr);
+}
+
+static void start_loop_pairing(std::function<void(uint32_t)> done) {
+    LoopPairing &p = g_loop_pairing;
+    if (p.timer < 0) {
+        p.timer = g_loop->addTimer(0, 0, [] {
+            if (g_loop_pairing.active) finish_loop_pairing(0);
+        });
+    }
+    p.reader = g_rx_ring.reader();
+    p.done   = std::move(done);
+    p.active = true;
+    g_loop->setTimer(p.timer, 60000);
+}
+
+// Threaded streaming pairing: handle_command leaves the completion here for
+// stream_state_loop, which is joined before the radio and MQTT go away.
+static std::mutex g_stream_pairing_mutex;
+static std::function<void(uint32_t)> g_stream_pairing;
+
+static void check_loop_pairing() {
+    if (!g_loop_pairing.active) return;
+    uint32_t addr = pairing_candidate(g_loop_pairing.reader);
+    if (addr != 0) finish_loop_pairing(addr);
+}
+
+void handle_command(RadioWorker &radio,
+                    const std::string &topic,
+                    const std::string &payload,
+                    struct mosquitto *mosq) {
+
+    std::cout << "Received command: " << topic << ", with payload: " << payload << "\n" << std::flush;
+    if (topic == T_PAIR_C) {
         if (payload == "ON" && !g_pairing.exchange(true)) {
             mqtt_publish(mosq, T_PAIR_S, "ON");
             std::cout << "Starting pairing...\n" << std::flush;
-            std::thread([&heater, mosq, &heater_addr]() {
-                uint32_t addr = heater.findAddress(60000);
+            auto paired = [mosq, &radio](uint32_t addr) {
                 if (addr != 0) {
                     std::cout << "Paired heater address: 0x" << std::hex << addr << std::dec << "\n" << std::flush;
-                    heater_addr = addr;
-                    heater.setAddress(addr);
-                    save_address(addr);
+                    register_paired(radio, mosq, addr);
                 } else {
                     std::cout << "Pairing timed out, no address found.\n" << std::flush;
                 }
                 mqtt_publish(mosq, T_PAIR_S, "OFF");
                 g_pairing = false;
-            }).detach();
+            };
+            if (g_streaming && g_loop) {
+                start_loop_pairing(paired);
+            } else if (g_streaming) {
+                // Take the first heater heard on the shared frame ring (the
+                // first not yet paired, in multi-heater mode); the radio keeps
+                // serving everyone else meanwhile. The state thread runs the
+                // search (see stream_state_loop).
+                std::lock_guard<std::mutex> lock(g_stream_pairing_mutex);
+                g_stream_pairing = paired;
+            } else {
+                // Pairing holds the radio for up to a minute; queued commands
+                // wait behind it rather than interrupting it.
+                radio.submit(RadioWorker::Priority::Command, [paired](DieselHeaterRF &heater) {
+                    uint32_t addr = heater.findAddress(60000);
+                    on_loop([paired, addr] { paired(addr); });
+                });
+            }
+        }
+        return;
+    }
+
+    if (topic == T_RXMODE_C) {
+        if (!g_streaming) {
+            std::cout << "rx_mode needs continuous receive (RX_STREAMING=1); ignored\n" << std::flush;
+            return;
+        }
+        if (payload != "continuous" && payload != "wor") return;
+        bool wor = payload == "wor";
+        if (g_wor.exchange(wor) != wor) {
+            radio.setWakeOnRadio(wor, g_wor_period_ms, g_wor_rx_time);
+            std::cout << "Receive mode: " << payload << "\n" << std::flush;
+        }
+        mqtt_publish(mosq, T_RXMODE_S, payload, true);
+        return;
+    }
+
+    Heater *heaters[kMaxHeaters];
+    size_t count = heater_snapshot(heaters, kMaxHeaters);
+    for (size_t i = 0; i < count; i++) {
+        Heater *h = heaters[i];
+        switch (classify_topic(h->topics, topic)) {
+            case HeaterTopicKind::HistoryQuery:
+                handle_history_query(*h, payload, mosq);
+                return;
+            case HeaterTopicKind::Command:
+                handle_heater_command(radio, *h, topic, payload, mosq);
+                return;
+            case HeaterTopicKind::None:
+                break;
         }
     }
 }
@@ -392,15 +1092,7 @@ void handle_command(DieselHeaterRF &heater,
 void on_message(struct mosquitto *mosq, void *userdata,
                 const struct mosquitto_message *msg) {
     if (!msg || !msg->topic) return;
-    auto *heater = static_cast<DieselHeaterRF*>(userdata);
-
-    static uint32_t heater_addr_cache = 0;
-    if (heater_addr_cache == 0) {
-        heater_addr_cache = load_address();
-        if (heater_addr_cache != 0) {
-            heater->setAddress(heater_addr_cache);
-        }
-    }
+    auto *radio = static_cast<RadioWorker*>(userdata);
 
     std::string topic((const char*)msg->topic);
     std::string payload;
@@ -408,61 +1100,405 @@ void on_message(struct mosquitto *mosq, void *userdata,
         payload.assign((const char*)msg->payload, msg->payloadlen);
     }
 
-    handle_command(*heater, topic, payload, mosq, heater_addr_cache);
+    handle_command(*radio, topic, payload, mosq);
+}
+
+// Radio link quality for one heater, once a minute of receive time:
+//   {"freq_offset_khz":-12.70,"freq_offset_steps":-8.00,"fsctrl0":-8,
+//    "frames":58,"success_rate":0.983}
+// frames counts this heater's status packets in the window; success_rate is
+// the share of all packets drained from the FIFO in the window that passed
+// the length and CRC checks. The learned offset (null until measured) is
+// also written to FREQ_FILE when it has moved by half a step.
+static void publish_rx_quality(struct mosquitto *mosq, Heater &heater, uint64_t timestampUs) {
+    static constexpr double kStepKhz = 26e3 / 16384.0; // FSCTRL0 step, fXOSC / 2^14
+    // Registered by DieselHeaterRF
+    static Counter &rx_packets      = metrics().counter("cc1101_rx_packets_total");
+    static Counter &rx_crc_errors   = metrics().counter("cc1101_rx_crc_errors_total");
+    static Counter &rx_wrong_length = metrics().counter("cc1101_rx_wrong_length_total");
+
+    if (heater.quality_us != 0 && timestampUs - heater.quality_us < 60000000ull) return;
+    uint64_t good = rx_packets.value();
+    uint64_t bad  = rx_crc_errors.value() + rx_wrong_length.value();
+    uint64_t frames = heater.pending.frames - heater.quality_frames;
+    uint64_t window_good = good - heater.quality_good, window_bad = bad - heater.quality_bad;
+    heater.quality_us     = timestampUs;
+    heater.quality_frames = heater.pending.frames;
+    heater.quality_good   = good;
+    heater.quality_bad    = bad;
+
+    float steps = 0;
+    bool learned = g_chip && g_chip->freqTracking() &&
+                   g_chip->freqOffset(heater.addr.load(std::memory_order_relaxed), &steps);
+    char offset_khz[16] = "null", offset_steps[16] = "null", rate[16] = "null";
+    if (learned) {
+        std::snprintf(offset_khz, sizeof(offset_khz), "%.2f", steps * kStepKhz);
+        std::snprintf(offset_steps, sizeof(offset_steps), "%.2f", steps);
+    }
+    if (window_good + window_bad)
+        std::snprintf(rate, sizeof(rate), "%.3f", double(window_good) / double(window_good + window_bad));
+    char json[192];
+    int n = std::snprintf(json, sizeof(json),
+        "{\"freq_offset_khz\":%s,\"freq_offset_steps\":%s,\"fsctrl0\":%d,"
+        "\"frames\":%llu,\"success_rate\":%s}",
+        offset_khz, offset_steps, g_chip ? int(g_chip->appliedFreqOffset()) : 0,
+        (unsigned long long)frames, rate);
+    mqtt_publish(mosq, heater.topics.rx_quality, json, (size_t)n);
+
+    if (learned && (!heater.offset_saved || std::fabs(steps - heater.saved_offset) >= 0.5f)) {
+        heater.saved_offset = steps;
+        heater.offset_saved = true;
+        save_freq_offsets();
+    }
+}
+
+// Publish one decoded state to a heater's sensor topics (see
+// publish_telemetry) and the shared-memory snapshot. timestampUs is the
+// receive time and also drives the keepalive cycle, so a replayed capture
+// publishes identically.
+void publish_state(struct mosquitto *mosq, Heater &heater, const heater_state_t &st, uint64_t timestampUs) {
+    // Registered by DieselHeaterRF
+    static Counter &rx_packets    = metrics().counter("cc1101_rx_packets_total");
+    static Counter &rx_crc_errors = metrics().counter("cc1101_rx_crc_errors_total");
+    remember_state(heater, st);
+    if (g_state_shm.isOpen()) {
+        g_state_shm.update(heater.shm_slot, heater.addr.load(std::memory_order_relaxed), st,
+                           timestampUs, heater.pending.frames);
+        g_state_shm.setCounters(rx_packets.value(), rx_crc_errors.value());
+    }
+
+    // remember last state code
+    heater.last_state_code.store(st.state, std::memory_order_relaxed);
+
+    heater.history.record((uint32_t)std::time(nullptr), st, heater_is_on(st.state));
+
+    publish_telemetry([mosq](const std::string &topic, const char *payload, size_t len) {
+        mqtt_publish(mosq, topic, payload, len);
+    }, heater.topics, heater.delta, st, uint32_t(timestampUs / 1000));
+
+    publish_rx_quality(mosq, heater, timestampUs);
+}
+
+// A state from a polled receive window (single heater)
+static void publish_polled(struct mosquitto *mosq, const heater_state_t &st) {
+    Heater *heater;
+    if (heater_snapshot(&heater, 1) == 0) return;
+    heater->pending.frames++;
+    uint64_t now_us = wall_clock_us();
+    if (g_capture) g_capture->appendDrain(now_us);
+    publish_state(mosq, *heater, st, now_us);
+}
+
+// CPU time consumed by the calling thread, in microseconds.
+static uint64_t thread_cpu_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return uint64_t(ts.tv_sec) * 1000000u + uint64_t(ts.tv_nsec) / 1000u;
 }
 
-// Poll heater state and publish to MQTT
-void state_loop(DieselHeaterRF &heater, struct mosquitto *mosq) {
+// One polled receive window, on the radio thread. The first one also reports
+// what it cost.
+static std::optional<heater_state_t> poll_once(DieselHeaterRF &heater, bool report) {
     heater_state_t st{};
+    uint64_t syscalls = piSyscallCount();
+    uint64_t cpu_us   = thread_cpu_us();
+    uint32_t wall_ms  = millis();
+    bool got_state = heater.getState(&st, 1000);
+    if (report) {
+        std::cout << "First receive window: " << (millis() - wall_ms) << " ms wall, "
+                  << (thread_cpu_us() - cpu_us) / 1000.0 << " ms CPU, "
+                  << (piSyscallCount() - syscalls) << " GPIO/SPI syscalls\n" << std::flush;
+    }
+    if (got_state) return st;
+    return std::nullopt;
+}
+
+// Poll heater state and publish to MQTT (single heater only)
+void state_loop(RadioWorker &radio, struct mosquitto *mosq) {
+    bool first_poll = true;
     while (g_running) {
         if (g_pairing.load(std::memory_order_relaxed)) {
             // Yield the CC1101 RX FIFO to the pairing thread while pairing is active.
             std::this_thread::sleep_for(std::chrono::milliseconds(500));
             continue;
         }
-        if (heater.getState(&st, 1000)) {
-            // remember last state code
-            g_last_state_code.store(st.state, std::memory_order_relaxed);
-            bool is_on = heater_is_on(st.state);
-
-            mqtt_publish(mosq, T_TEMP,  std::to_string(st.ambientTemp));
-            mqtt_publish(mosq, T_VOLT,  std::to_string(st.voltage));
-            mqtt_publish(mosq, T_CASE,  std::to_string(st.caseTemp));
-            mqtt_publish(mosq, T_PFREQ, std::to_string(st.pumpFreq));
-            mqtt_publish(mosq, T_HSTATE,     std::to_string(st.state));
-            mqtt_publish(mosq, T_HSTATE_TXT, heater_state_to_str(st.state));
-            mqtt_publish(mosq, T_RSSI,       std::to_string(st.rssi));
-            mqtt_publish(mosq, T_POWER_S, is_on ? "ON" : "OFF");
-
-            std::string raw = "{"
-                              "\"state\":" + std::to_string(st.state) + "," +
-                              "\"power\":" + std::to_string(st.power) + "," +
-                              "\"voltage\":" + std::to_string(st.voltage) + "," +
-                              "\"ambientTemp\":" + std::to_string(st.ambientTemp) + "," +
-                              "\"caseTemp\":" + std::to_string(st.caseTemp) + "," +
-                              "\"setpoint\":" + std::to_string(st.setpoint) + "," +
-                              "\"autoMode\":" + std::to_string(st.autoMode) + "," +
-                              "\"pumpFreq\":" + std::to_string(st.pumpFreq) + "," +
-                              "\"rssi\":" + std::to_string(st.rssi) +
-                              "}";
-            mqtt_publish(mosq, T_STATE_RAW, raw);
+        auto pending = radio.submit(RadioWorker::Priority::Poll,
+            [first_poll](DieselHeaterRF &heater) { return poll_once(heater, first_poll); });
+        first_poll = false;
+        std::optional<heater_state_t> polled;
+        try {
+            polled = pending.get();
+        } catch (const std::future_error &) {
+            break; // Radio worker stopped
+        } catch (const std::exception &e) {
+            std::cerr << "Poll error: " << e.what() << "\n" << std::flush;
         }
+        if (polled) publish_polled(mosq, *polled);
         std::this_thread::sleep_for(std::chrono::seconds(5));
     }
     std::cout << "Exited state listener\n" << std::flush;
 }
 
+// Publishes frames from the continuous-RX ring, routed to the heater they are
+// addressed from. Once a minute, reports how many frames the current receive
+// mode caught against the last continuous-RX minute.
+class FramePublisher
+{
+
+public:
+
+    explicit FramePublisher(struct mosquitto *mosq)
+        : _mosq(mosq), _reader(g_rx_ring.reader()),
+          _windowWor(g_wor.load()), _windowStart(millis()), _windowFrames(g_rx_ring.pushed()) {}
+
+    // Capture-rate window; call at least every few seconds.
+    void tick() {
+        if (g_wor.load() != _windowWor) {
+            // Mode changed: start a fresh window
+            _windowWor    = g_wor.load();
+            _windowStart  = millis();
+            _windowFrames = g_rx_ring.pushed();
+        } else if (millis() - _windowStart >= 60000) {
+            uint64_t pushed = g_rx_ring.pushed();
+            uint64_t frames = (pushed - _windowFrames) * 60000 / (millis() - _windowStart);
+            if (!_windowWor) _baseline = frames;
+            PayloadBuffer json;
+            json.append(_windowWor ? R"({"mode":"wor")" : R"({"mode":"continuous")")
+                .append(",\"frames_per_min\":").appendInt((long long)frames)
+                .append(",\"capture_rate\":");
+            if (_baseline) json.appendFixed((double)frames / (double)_baseline, 3);
+            else json.append("null");
+            json.append("}");
+            mqtt_publish(_mosq, T_CAPTURE, json);
+            _windowStart  = millis();
+            _windowFrames = pushed;
+        }
+    }
+
+    // Several frames may have queued up since the last call; only the newest
+    // one per paired heater is worth publishing (see PendingState).
+    void publishFrames() {
+        static Counter &ring_dropped = metrics().counter(
+            "rx_ring_dropped_total", "Frames overwritten before the publisher read them");
+        static Histogram &pickup = metrics().histogram(
+            "rx_publish_latency_seconds", "Time from a frame leaving the radio to the publisher reading it");
+        heater_frame_t frame;
+        uint64_t dropped_before = _dropped;
+        uint64_t now_us = wall_clock_us(), newest_us = 0;
+        while (_reader.pop(frame, &_dropped)) {
+            if (now_us > frame.timestampUs) pickup.observeUs(now_us - frame.timestampUs);
+            newest_us = frame.timestampUs;
+            offer_frame([](uint32_t addr) -> PendingState * {
+                Heater *h = find_heater(addr);
+                return h ? &h->pending : nullptr;
+            }, frame.data, frame.timestampUs);
+        }
+        if (newest_us && g_capture) g_capture->appendDrain(newest_us);
+        Heater *heaters[kMaxHeaters];
+        size_t count = heater_snapshot(heaters, kMaxHeaters);
+        for (size_t i = 0; i < count; i++) {
+            Heater *h = heaters[i];
+            if (!h->pending.take()) continue;
+            publish_state(_mosq, *h, h->pending.state, h->pending.timestampUs);
+        }
+        if (_dropped != dropped_before) ring_dropped.inc(_dropped - dropped_before);
+    }
+
+    uint64_t dropped() const { return _dropped; }
+
+private:
+
+    struct mosquitto       *_mosq;
+    HeaterFrameRing::Reader _reader;
+    uint64_t                _dropped = 0;
+
+    bool     _windowWor;
+    uint32_t _windowStart;
+    uint64_t _windowFrames;
+    uint64_t _baseline = 0; // Frames per minute in continuous RX, 0 = not yet measured
+};
+
+// Publish streamed frames, checking the ring every 100 ms, and run pairing
+// searches handed over by handle_command.
+void stream_state_loop(struct mosquitto *mosq) {
+    FramePublisher frames(mosq);
+    std::function<void(uint32_t)> pairing;
+    HeaterFrameRing::Reader pairing_reader;
+    uint32_t pairing_start = 0;
+    while (g_running) {
+        frames.tick();
+        frames.publishFrames();
+        if (!pairing) {
+            std::lock_guard<std::mutex> lock(g_stream_pairing_mutex);
+            if (g_stream_pairing) {
+                pairing = std::move(g_stream_pairing);
+                g_stream_pairing = nullptr;
+                pairing_reader = g_rx_ring.reader();
+                pairing_start  = millis();
+            }
+        }
+        if (pairing) {
+            uint32_t addr = pairing_candidate(pairing_reader);
+            if (addr != 0 || millis() - pairing_start >= 60000) {
+                std::function<void(uint32_t)> done = std::move(pairing);
+                pairing = nullptr;
+                done(addr);
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    // Publish what was received before the radio stopped, as a replay would
+    while (!g_radio_stopped) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    frames.publishFrames();
+    std::cout << "Exited state listener (" << g_rx_ring.pushed() << " frames received, "
+              << frames.dropped() << " dropped)\n" << std::flush;
+}
+
+// Event-loop mode: one thread waits in epoll on the MQTT socket, the frame
+// eventfd the radio worker bumps after each packet (GDO2), timers and
+// SIGINT/SIGTERM, and handles each as it arrives. Returns on a signal.
+static void run_event_loop(EventLoop &loop, RadioWorker &radio, struct mosquitto *mosq,
+                           int frame_fd, uint32_t stats_interval_ms) {
+    loop.addSignals({SIGINT, SIGTERM}, [&loop](int) {
+        std::cout << "Exit request received\n" << std::flush;
+        g_running = false;
+        loop.stop();
+    });
+
+    // MQTT: read when the socket is readable, write while libmosquitto has
+    // output queued, reconnect on a timer after an error.
+    int      sock        = -1;
+    uint32_t sock_events = 0;
+    int      reconnect   = -1;
+    auto lost = [&](int rc) {
+        std::cerr << "MQTT loop error (" << rc << "), reconnecting...\n" << std::flush;
+        if (sock >= 0) loop.remove(sock);
+        sock = -1;
+        loop.setTimer(reconnect, 2000);
+    };
+    auto on_socket = [&](uint32_t events) {
+        int rc = MOSQ_ERR_SUCCESS;
+        if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) rc = mosquitto_loop_read(mosq, 1);
+        if (rc == MOSQ_ERR_SUCCESS && (events & EPOLLOUT)) rc = mosquitto_loop_write(mosq, 1);
+        if (rc != MOSQ_ERR_SUCCESS) lost(rc);
+    };
+    auto attach = [&]() {
+        sock        = mosquitto_socket(mosq);
+        sock_events = EPOLLIN;
+        if (sock < 0 || !loop.add(sock, sock_events, on_socket)) {
+            sock = -1;
+            return false;
+        }
+        return true;
+    };
+    reconnect = loop.addTimer(0, 0, [&]() {
+        if (mosquitto_reconnect(mosq) != MOSQ_ERR_SUCCESS || !attach())
+            loop.setTimer(reconnect, 2000);
+    });
+    if (!attach()) lost(MOSQ_ERR_NO_CONN);
+    loop.setIdleHook([&]() {
+        if (sock < 0) return;
+        uint32_t want = uint32_t(EPOLLIN) | (mosquitto_want_write(mosq) ? uint32_t(EPOLLOUT) : 0u);
+        if (want != sock_events && loop.modify(sock, want)) sock_events = want;
+    });
+
+    // Keepalive pings (mosquitto_loop_misc) and the capture-rate window
+    std::unique_ptr<FramePublisher> frames;
+    if (g_streaming) frames.reset(new FramePublisher(mosq));
+    loop.addTimer(1000, 1000, [&]() {
+        if (sock >= 0) mosquitto_loop_misc(mosq);
+        if (frames) frames->tick();
+    });
+    if (stats_interval_ms) {
+        loop.addTimer(stats_interval_ms, stats_interval_ms, [mosq]() {
+            mqtt_publish(mosq, T_STATS, metrics().json());
+        });
+    }
+
+    int  poll_timer = -1;
+    bool first_poll = true;
+    if (g_streaming) {
+        loop.add(frame_fd, EPOLLIN, [&](uint32_t) {
+            uint64_t n;
+            (void)::read(frame_fd, &n, sizeof(n));
+            frames->publishFrames();
+            check_loop_pairing();
+        });
+    } else {
+        // One receive window at a time, the next 5 s after the last one ended
+        poll_timer = loop.addTimer(1, 0, [&]() {
+            if (g_pairing.load(std::memory_order_relaxed)) {
+                loop.setTimer(poll_timer, 500);
+                return;
+            }
+            bool report = first_poll;
+            first_poll = false;
+            radio.submit(RadioWorker::Priority::Poll, [&loop, poll_timer, report, mosq](DieselHeaterRF &heater) {
+                std::optional<heater_state_t> polled;
+                try {
+                    polled = poll_once(heater, report);
+                } catch (const std::exception &e) {
+                    std::cerr << "Poll error: " << e.what() << "\n" << std::flush;
+                }
+                loop.post([&loop, poll_timer, polled, mosq] {
+                    if (polled) publish_polled(mosq, *polled);
+                    loop.setTimer(poll_timer, 5000);
+                });
+            });
+        });
+    }
+
+    loop.run();
+    radio.stop();
+    if (frames) {
+        frames->publishFrames(); // What was received before the radio stopped
+        std::cout << "Exited event loop (" << g_rx_ring.pushed() << " frames received, "
+                  << frames->dropped() << " dropped)\n" << std::flush;
+    }
+}
+
 void handle_signal(int) {
     std::cout << "Exit request received\n" << std::flush;
     g_running = false;
 }
 
 int main() {
-    std::signal(SIGINT, handle_signal);
-    std::signal(SIGTERM, handle_signal);
+    bool event_loop = get_env_int_or("EVENT_LOOP", 0) != 0;
+    if (event_loop) {
+        // Before any thread starts, so the signals only arrive via signalfd
+        EventLoop::blockSignals({SIGINT, SIGTERM});
+    } else {
+        std::signal(SIGINT, handle_signal);
+        std::signal(SIGTERM, handle_signal);
+    }
+
+    // The real chip on the Pi, or the in-process simulator (SIM_CC1101=1)
+    // so the bridge runs on any Linux box.
+    std::unique_ptr<CC1101Transport> transport;
+    if (get_env_int_or("SIM_CC1101", 0) != 0) {
+        CC1101Sim::Config sim = CC1101Sim::Config::fromEnv();
+        std::cout << "Using simulated CC1101 with " << sim.heaters.size() << " heater(s) at "
+                  << sim.rateHz << " Hz\n" << std::flush;
+        transport.reset(new CC1101Sim(sim));
+    } else {
+        auto *pi = new PiTransport(HEATER_SPI_DEVICE, HEATER_SPI_SPEED_HZ,
+                                   HEATER_SCK_PIN, HEATER_MISO_PIN, HEATER_MOSI_PIN,
+                                   HEATER_SS_PIN, HEATER_GDO2_PIN);
+        transport.reset(pi);
+        // SPI_CS_MODE=hardware: CE0 frames transactions and CHIP_RDYn comes
+        // from the status byte, so no GPIO calls on the SPI path.
+        std::string cs_mode = get_env_or("SPI_CS_MODE", "gpio");
+        if (cs_mode == "hardware" || cs_mode == "hw")
+            pi->setCsMode(PiTransport::CsMode::Hardware, (uint16_t)get_env_int_or("SPI_CS_LEAD_US", 0));
+        else if (cs_mode != "gpio")
+            std::cerr << "Unknown SPI_CS_MODE '" << cs_mode << "', using gpio\n" << std::flush;
+    }
 
     // SPI sanity check before doing anything else
-    if (!cc1101_startup_check()) {
+    bool cold_start = get_env_int_or("CC1101_COLD_START", 1) != 0;
+    bool calibrate_spi = get_env_or("SPI_SPEED_HZ", "") == "auto";
+    uint32_t spi_speed_hz = calibrate_spi ? 0 : (uint32_t)get_env_int_or("SPI_SPEED_HZ", 0);
+    if (!cc1101_startup_check(*transport, cold_start, spi_speed_hz, calibrate_spi)) {
         std::cerr << "CC1101 startup check failed; check wiring/power.\n";
         return 1;
     }
@@ -472,20 +1508,113 @@ int main() {
     int mqtt_port         = get_env_int_or("MQTT_PORT", 1883);
     std::cout << "Using MQTT host " << mqtt_host << ":" << std::to_string(mqtt_port) << "\n" << std::flush;
 
-    DieselHeaterRF heater;
-    heater.begin();
-    std::cout << "Radio initialised\n" << std::flush;
+    g_delta_policy = DeltaPolicy::fromEnv();
+    g_history          = get_env_int_or("HISTORY", 0) != 0;
+    g_history_dir      = get_env_or("HISTORY_DIR", "/data");
+    g_history_sample_s = (uint32_t)get_env_int_or("HISTORY_SAMPLE_S", 5);
+    g_multi     = get_env_int_or("MULTI_HEATER", 0) != 0;
+    g_streaming = get_env_int_or("RX_STREAMING", 0) != 0;
+    if (g_multi && !g_streaming) {
+        std::cout << "MULTI_HEATER needs continuous receive; enabling RX_STREAMING\n" << std::flush;
+        g_streaming = true;
+    }
+    g_ack_commands = get_env_int_or("ACK_COMMANDS", 0) != 0;
+    g_wor_period_ms = (uint16_t)get_env_int_or("WOR_PERIOD_MS", 25);
+    g_wor_rx_time   = (uint8_t)get_env_int_or("WOR_RX_TIME", 0);
+    g_wor = g_streaming && get_env_or("RX_MODE", "continuous") == "wor";
+    std::cout << "Receive mode: " << (g_streaming ? (g_wor ? "wake-on-radio" : "continuous") : "polled")
+              << (g_multi ? ", multi-heater" : "") << "\n" << std::flush;
+
+    // Prometheus endpoint, local only unless METRICS_ADDR says otherwise
+    MetricsServer metrics_server;
+    int metrics_port = get_env_int_or("METRICS_PORT", 0);
+    std::string metrics_addr = get_env_or("METRICS_ADDR", "127.0.0.1");
+    if (metrics_port > 0) {
+        if (metrics_server.start(metrics_addr.c_str(), (uint16_t)metrics_port))
+            std::cout << "Serving metrics on " << metrics_addr << ":" << metrics_port << "/metrics\n" << std::flush;
+        else
+            std::cerr << "Could not listen on metrics address " << metrics_addr << ":" << metrics_port << "\n" << std::flush;
+    }
+    uint32_t stats_interval_ms = (uint32_t)get_env_int_or("MQTT_STATS_S", 0) * 1000u;
+
+    // Shared-memory snapshot for diesel_heater_state and other local readers
+    if (get_env_int_or("STATE_SHM", 0) != 0) {
+        std::string shm_name = get_env_or("STATE_SHM_NAME", "/diesel_heater");
+        std::string error;
+        if (g_state_shm.open(shm_name, &error))
+            std::cout << "Publishing live state to shared memory " << shm_name << "\n" << std::flush;
+        else
+            std::cerr << "Shared-memory state disabled: " << error << "\n" << std::flush;
+    }
+
+    DieselHeaterRF heater(*transport);
+    g_chip = &heater;
+    heater.setColdStart(cold_start);
+    if (get_env_int_or("FREQ_TRACKING", 0) != 0)
+        heater.setFreqTracking(true, (uint8_t)get_env_int_or("FREQ_TRACK_THRESHOLD", 2));
+    uint64_t syscalls = piSyscallCount();
+    uint32_t init_us  = micros();
+    try {
+        heater.begin();
+    } catch (const std::exception &e) {
+        // E.g. CHIP_RDYn never going low
+        std::cerr << "CC1101 initialisation failed: " << e.what() << "; check wiring/power.\n";
+        return 1;
+    }
+    init_us = micros() - init_us;
+    std::cout << "Radio initialised (";
+    if (heater.startRewrites() >= 0)
+        std::cout << "warm, " << heater.startRewrites() << " register(s) rewritten, ";
+    else
+        std::cout << "reset, ";
+    std::cout << init_us / 1000.0 << " ms, " << (piSyscallCount() - syscalls)
+              << " GPIO/SPI syscalls, " << transport->name()
+              << ")\n" << std::flush;
+
+    // Record received packets for diesel_heater_replay
+    CaptureWriter capture;
+    std::string capture_path = get_env_or("CAPTURE_FILE", "");
+    if (!capture_path.empty()) {
+        std::string error;
+        if (capture.open(capture_path, &error)) {
+            heater.setCapture(&capture);
+            g_capture = &capture;
+            std::cout << "Capturing received packets to " << capture_path << "\n" << std::flush;
+        } else {
+            std::cerr << "Capture disabled: " << error << "\n" << std::flush;
+        }
+    }
 
-    uint32_t addr = load_address();
-    if (addr != 0) {
+    std::vector<uint32_t> addrs = load_addresses();
+    for (uint32_t addr : addrs) {
         std::cout << "Using heater address: 0x" << std::hex << addr << std::dec << "\n" << std::flush;
-        heater.setAddress(addr);
-    } else {
+        add_heater(addr);
+    }
+    if (addrs.empty()) {
         std::cout << "No saved address; use MQTT pairing switch.\n" << std::flush;
+    } else if (!g_multi) {
+        heater.setAddress(addrs[0]);
     }
+    if (heater.freqTracking()) load_freq_offsets(heater);
 
     mosquitto_lib_init();
-    struct mosquitto *mosq = mosquitto_new(CLIENT_ID, true, &heater);
+
+    std::unique_ptr<EventLoop> loop;
+    int frame_fd = -1;
+    if (event_loop) {
+        loop.reset(new EventLoop());
+        g_loop   = loop.get();
+        frame_fd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    }
+
+    RadioWorker radio(heater);
+    radio.setAckPolicy((uint8_t)get_env_int_or("ACK_BURST", 2), HEATER_TX_REPEAT,
+                       (uint16_t)get_env_int_or("ACK_LISTEN_MS", 500));
+    if (g_wor) heater.setWakeOnRadio(true, g_wor_period_ms, g_wor_rx_time);
+    if (g_streaming) radio.setStreaming(&g_rx_ring, frame_fd);
+    radio.start();
+
+    struct mosquitto *mosq = mosquitto_new(CLIENT_ID, true, &radio);
     if (!mosq) {
         std::cerr << "mosquitto_new failed\n" << std::flush;
         return 1;
@@ -505,40 +1634,64 @@ int main() {
     }
     std::cout << "MQTT connected\n" << std::flush;
 
-    // Subscribe to all command topics
-    mosquitto_subscribe(mosq, nullptr, T_POWER_C.c_str(), 0);
-    mosquitto_subscribe(mosq, nullptr, T_MODE_C.c_str(), 0);
+    // Subscribe to all command topics and announce discovery. In single-heater
+    // mode the (historical) heater topics exist even before pairing.
+    if (!g_multi && heater_list().empty()) add_heater(0);
     mosquitto_subscribe(mosq, nullptr, T_PAIR_C.c_str(), 0);
-    mosquitto_subscribe(mosq, nullptr, T_CMD_WAKEUP.c_str(), 0);
-    mosquitto_subscribe(mosq, nullptr, T_CMD_MODE.c_str(), 0);
-    mosquitto_subscribe(mosq, nullptr, T_CMD_POWER.c_str(), 0);
-    mosquitto_subscribe(mosq, nullptr, T_CMD_UP.c_str(), 0);
-    mosquitto_subscribe(mosq, nullptr, T_CMD_DOWN.c_str(), 0);
+    if (g_streaming) {
+        mosquitto_subscribe(mosq, nullptr, T_RXMODE_C.c_str(), 0);
+        mqtt_publish(mosq, T_RXMODE_S, g_wor ? "wor" : "continuous", true);
+    }
+    publish_bridge_discovery(mosq);
+    for (Heater *h : heater_list()) {
+        subscribe_heater(mosq, h->topics);
+        publish_discovery(mosq, h->topics);
+    }
     std::cout << "Subscribed to topics\n" << std::flush;
-
-    // Announce discovery
-    publish_discovery(mosq);
     std::cout << "Published HA discovery topics\n" << std::flush;
 
     // Start state loop
-    std::thread t_state(state_loop, std::ref(heater), mosq);
-    std::cout << "Started state listener\n" << std::flush;
+    std::thread t_state;
+    if (!g_loop) {
+        t_state = g_streaming
+            ? std::thread(stream_state_loop, mosq)
+            : std::thread(state_loop, std::ref(radio), mosq);
+        std::cout << "Started state listener\n" << std::flush;
+    }
 
     // Available
     mqtt_publish(mosq, T_AVAIL, "online", true);
 
-    // MQTT loop
-    while (g_running) {
-        int rc = mosquitto_loop(mosq, 1000, 1);
-        if (rc != MOSQ_ERR_SUCCESS) {
-            std::cerr << "MQTT loop error (" << rc << "), reconnecting...\n" << std::flush;
-            std::this_thread::sleep_for(std::chrono::seconds(2));
-            mosquitto_reconnect(mosq);
+    if (g_loop) {
+        std::cout << "Running event loop\n" << std::flush;
+        run_event_loop(*g_loop, radio, mosq, frame_fd, stats_interval_ms);
+    } else {
+        // MQTT loop
+        uint32_t last_stats_ms = millis();
+        while (g_running) {
+            if (stats_interval_ms && millis() - last_stats_ms >= stats_interval_ms) {
+                last_stats_ms = millis();
+                mqtt_publish(mosq, T_STATS, metrics().json());
+            }
+            int rc = mosquitto_loop(mosq, 1000, 1);
+            if (rc != MOSQ_ERR_SUCCESS) {
+                std::cerr << "MQTT loop error (" << rc << "), reconnecting...\n" << std::flush;
+                std::this_thread::sleep_for(std::chrono::seconds(2));
+                mosquitto_reconnect(mosq);
+            }
         }
     }
     std::cout << "Exited MQTT listener\n" << std::flush;
 
-    t_state.join();
+    radio.stop();
+    g_radio_stopped = true;
+    if (t_state.joinable()) t_state.join();
+    if (heater.freqTracking()) save_freq_offsets();
+    if (frame_fd >= 0) ::close(frame_fd);
+    if (capture.isOpen())
+        std::cout << "Captured " << capture.records() << " packets\n" << std::flush;
+    metrics_server.stop();
+    g_state_shm.close();
     mqtt_publish(mosq, T_AVAIL, "offline", true);
     mosquitto_destroy(mosq);
     mosquitto_lib_cleanup();
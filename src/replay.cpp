@@ -0,0 +1,284 @@
+/*
+ * replay.cpp
+ *
+ * Stream a packet capture (CAPTURE_FILE) through the bridge's decode and
+ * publish pipeline, as fast as possible or in real time.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "CaptureFile.h"
+#include "DeltaPublisher.h"
+#include "DieselHeaterRF.h"
+#include "StatePublisher.h"
+#include "crc16_modbus.h"
+
+struct ReplayHeater {
+    uint32_t       addr;
+    HeaterTopics   topics;
+    DeltaPublisher delta;
+    PendingState   pending;
+
+    ReplayHeater(uint32_t a, HeaterTopics t) : addr(a), topics(std::move(t)) {}
+
+    // The topics publish_telemetry() writes; the rest of a publish log
+    // (discovery, rx_quality, command echoes) has no counterpart in a replay.
+    bool isTelemetry(const std::string &topic) const {
+        return topic == topics.temp || topic == topics.volt || topic == topics.case_temp ||
+               topic == topics.pfreq || topic == topics.hstate || topic == topics.hstate_txt ||
+               topic == topics.rssi || topic == topics.power_s || topic == topics.setpoint ||
+               topic == topics.state_raw;
+    }
+};
+
+// Publishes go to stdout as "topic payload" lines (mosquitto_sub -v style)
+// and into an FNV-1a digest, so two runs can be compared by digest alone.
+// With expected set, each publish is also checked against the next line of
+// a publish log, and the first difference is remembered.
+struct ReplaySink {
+    bool     print     = true;
+    uint64_t publishes = 0;
+    uint64_t bytes     = 0;
+    uint64_t digest    = 0xcbf29ce484222325ull;
+
+    const std::vector<std::string> *expected = nullptr;
+    size_t      mismatchAt = SIZE_MAX;
+    std::string mismatch;
+
+    void hash(const char *p, size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            digest ^= uint8_t(p[i]);
+            digest *= 0x100000001b3ull;
+        }
+    }
+
+    void operator()(const std::string &topic, const char *payload, size_t len) {
+        publishes++;
+        bytes += topic.size() + len;
+        hash(topic.data(), topic.size());
+        hash("\0", 1);
+        hash(payload, len);
+        hash("\n", 1);
+        if (expected && mismatchAt == SIZE_MAX) {
+            std::string line = topic + ' ' + std::string(payload, len);
+            size_t i = publishes - 1;
+            if (i >= expected->size() || (*expected)[i] != line) {
+                mismatchAt = i;
+                mismatch   = line;
+            }
+        }
+        if (print) {
+            std::fwrite(topic.data(), 1, topic.size(), stdout);
+            std::fputc(' ', stdout);
+            std::fwrite(payload, 1, len, stdout);
+            std::fputc('\n', stdout);
+        }
+    }
+};
+
+// The lines of a "topic payload" publish log (mosquitto_sub -v) that belong
+// to the replayed heaters' telemetry, in order.
+static bool load_publish_log(const char *path, const std::deque<ReplayHeater> &heaters,
+                             std::vector<std::string> *out) {
+    std::ifstream f(path);
+    if (!f) return false;
+    std::string line;
+    while (std::getline(f, line)) {
+        std::string topic = line.substr(0, line.find(' '));
+        for (const ReplayHeater &h : heaters) {
+            if (h.isTelemetry(topic)) {
+                out->push_back(line);
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+static void usage(const char *argv0) {
+    std::fprintf(stderr,
+        "usage: %s [-r] [-s speed] [-m] [-a addr]... [-p file] [-d ms] [-c log] [-n loops] [-q] capture\n"
+        "  -r        real time: pace frames by their capture timestamps\n"
+        "  -s speed  real time at speed x (implies -r)\n"
+        "  -m        multi-heater topic layout (default: MULTI_HEATER)\n"
+        "  -a addr   paired heater address in hex; repeat for several (default: from -p)\n"
+        "  -p file   paired addresses, as the bridge keeps them (default: %s)\n"
+        "  -d ms     for captures without drain records (version 1): publish the\n"
+        "            newest frame per heater every ms of capture time (default: 100)\n"
+        "  -c log    check the publishes against a mosquitto_sub -v log of the bridge\n"
+        "  -n loops  replay the capture this many times\n"
+        "  -q        do not print publishes, only the summary\n"
+        "MQTT_KEEPALIVE_S and MQTT_DEADBAND_* apply as in the bridge.\n", argv0, HEATER_ADDR_FILE);
+}
+
+int main(int argc, char **argv) {
+    bool     realtime = false;
+    double   speed    = 1.0;
+    const char *multi_env = std::getenv("MULTI_HEATER");
+    bool     multi    = multi_env && std::atoi(multi_env) != 0;
+    std::vector<uint32_t> addrs;
+    const char *addr_file = HEATER_ADDR_FILE;
+    uint64_t drain_us = 100000;
+    const char *check_log = nullptr;
+    unsigned loops    = 1;
+    ReplaySink sink;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "rs:ma:p:d:c:n:qh")) != -1) {
+        switch (opt) {
+            case 'r': realtime = true; break;
+            case 's': realtime = true; speed = std::atof(optarg); break;
+            case 'm': multi = true; break;
+            case 'a': addrs.push_back((uint32_t)std::strtoul(optarg, nullptr, 16)); break;
+            case 'p': addr_file = optarg; break;
+            case 'd': drain_us = std::strtoull(optarg, nullptr, 10) * 1000u; break;
+            case 'c': check_log = optarg; break;
+            case 'n': loops = (unsigned)std::strtoul(optarg, nullptr, 10); break;
+            case 'q': sink.print = false; break;
+            default:  usage(argv[0]); return 2;
+        }
+    }
+    if (optind != argc - 1 || speed <= 0 || loops == 0) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    // The same heater table the bridge builds at startup
+    if (addrs.empty()) addrs = load_address_file(addr_file, multi);
+    else if (!multi) addrs.resize(1);
+    if (addrs.empty()) {
+        std::fprintf(stderr, "no paired heater address in %s; pass -a or -p\n", addr_file);
+        return 1;
+    }
+    const DeltaPolicy policy = DeltaPolicy::fromEnv();
+    const std::string base = HEATER_TOPIC_BASE;
+    std::deque<ReplayHeater> heaters;
+    for (uint32_t addr : addrs) {
+        heaters.emplace_back(addr, heater_topics(base, addr, multi));
+        policy.apply(heaters.back().delta);
+    }
+
+    std::vector<std::string> expected;
+    if (check_log) {
+        if (!load_publish_log(check_log, heaters, &expected)) {
+            std::fprintf(stderr, "%s: cannot read\n", check_log);
+            return 1;
+        }
+        sink.expected = &expected;
+    }
+    CaptureReader capture;
+    std::string error;
+    if (!capture.open(argv[optind], &error)) {
+        std::fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    if (capture.size() == 0) {
+        std::fprintf(stderr, "%s: no frames\n", argv[optind]);
+        return 1;
+    }
+
+    static char outbuf[1 << 16];
+    std::setvbuf(stdout, outbuf, _IOFBF, sizeof(outbuf));
+
+    auto find = [&heaters](uint32_t addr) -> PendingState * {
+        for (ReplayHeater &h : heaters)
+            if (h.addr == addr) return &h.pending;
+        return nullptr;
+    };
+    auto drain = [&heaters, &sink]() {
+        for (ReplayHeater &h : heaters)
+            if (h.pending.take())
+                publish_telemetry(sink, h.topics, h.delta, h.pending.state,
+                                  uint32_t(h.pending.timestampUs / 1000));
+    };
+
+    // Later loops continue the timeline one second after the previous one ended.
+    auto time_of = [](const CaptureRecord &r) {
+        return r.isDrain() ? r.drainedThroughUs() : r.timestampUs;
+    };
+    uint64_t first = time_of(capture[0]);
+    uint64_t span  = time_of(capture[capture.size() - 1]) - first + 1000000;
+
+    // Batch frames as the bridge did where it recorded its drains, else by
+    // drain_us of capture time.
+    bool recorded = std::any_of(capture.begin(), capture.end(),
+                                [](const CaptureRecord &r) { return r.isDrain(); });
+    std::deque<std::pair<uint64_t, const char *>> undrained;
+
+    uint64_t frames = 0, crc_errors = 0, ignored = 0, drain_end = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned loop = 0; loop < loops; loop++) {
+        for (const CaptureRecord &r : capture) {
+            uint64_t ts = time_of(r) + loop * span;
+            if (r.isDrain()) {
+                // Frames received after the drain's newest one wait for the next
+                while (!undrained.empty() && undrained.front().first <= ts) {
+                    if (!offer_frame(find, undrained.front().second, undrained.front().first)) ignored++;
+                    undrained.pop_front();
+                }
+                drain();
+                continue;
+            }
+            if (realtime) {
+                auto due = start + std::chrono::microseconds(uint64_t((ts - first) / speed));
+                std::this_thread::sleep_until(due);
+            }
+            frames++;
+            if (!recorded && ts >= drain_end) {
+                drain();
+                drain_end = ts + drain_us;
+            }
+
+            // Same acceptance as DieselHeaterRF::receiveFrame()
+            const uint8_t *b = reinterpret_cast<const uint8_t *>(r.data);
+            if (crc16::compute(b, 19) != ((uint16_t(b[19]) << 8) | b[20])) {
+                crc_errors++;
+                continue;
+            }
+
+            // Same routing as the bridge's FramePublisher
+            if (recorded) undrained.emplace_back(ts, r.data);
+            else if (!offer_frame(find, r.data, ts)) ignored++;
+        }
+    }
+    for (const auto &f : undrained)
+        if (!offer_frame(find, f.second, f.first)) ignored++;
+    drain();
+    std::fflush(stdout);
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::fprintf(stderr,
+        "%llu frames (%llu CRC errors, %llu from unpaired heaters), %zu heater(s), "
+        "%llu publishes, %llu bytes in %.3f s: %.0f frames/s, %.0f ns/frame, digest %016llx\n",
+        (unsigned long long)frames, (unsigned long long)crc_errors, (unsigned long long)ignored,
+        heaters.size(), (unsigned long long)sink.publishes, (unsigned long long)sink.bytes,
+        secs, secs > 0 ? frames / secs : 0.0, frames ? secs * 1e9 / frames : 0.0,
+        (unsigned long long)sink.digest);
+
+    if (check_log) {
+        if (sink.mismatchAt == SIZE_MAX && sink.publishes != expected.size()) {
+            sink.mismatchAt = std::min<size_t>(sink.publishes, expected.size());
+            sink.mismatch   = sink.publishes > expected.size() ? "(extra publishes)" : "(end of replay)";
+        }
+        if (sink.mismatchAt != SIZE_MAX) {
+            std::fprintf(stderr, "%s: differs at publish %zu: bridge \"%s\", replay \"%s\"\n",
+                         check_log, sink.mismatchAt + 1,
+                         sink.mismatchAt < expected.size() ? expected[sink.mismatchAt].c_str() : "(end of log)",
+                         sink.mismatch.c_str());
+            return 1;
+        }
+        std::fprintf(stderr, "%s: all %zu telemetry publishes match\n", check_log, expected.size());
+    }
+    return 0;
+}
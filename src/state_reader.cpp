@@ -0,0 +1,213 @@
+/*
+ * state_reader.cpp
+ *
+ * Print the bridge's live heater state from shared memory (STATE_SHM), or
+ * benchmark seqlock readers against a busy writer.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "StateShm.h"
+#include "TelemetryFormat.h"
+
+static uint64_t wall_clock_us() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static void usage(const char *argv0) {
+    std::fprintf(stderr,
+        "usage: %s [-n name] [-w] [-i ms] | -b seconds [-t readers]\n"
+        "  -n name     segment name (default: STATE_SHM_NAME or /diesel_heater)\n"
+        "  -w          watch: print every new state until interrupted\n"
+        "  -i ms       watch poll interval (default 100)\n"
+        "  -b seconds  benchmark readers against a writer updating flat out\n"
+        "  -t readers  reader threads for -b (default 1)\n", argv0);
+}
+
+// One JSON line: {"addr":"12345678","age_ms":812,"frames":42,"state":{...}}.
+// A heater paired but not heard from yet has "state":null.
+static void print_snapshot(const StateShmSnapshot &s) {
+    if (s.timestampUs == 0) {
+        std::printf("{\"addr\":\"%08" PRIx32 "\",\"timestamp_us\":0,\"age_ms\":null"
+                    ",\"frames\":0,\"state\":null}\n", s.addr);
+        return;
+    }
+    TextBuffer<256> raw;
+    format_state_raw(raw, s.state);
+    uint64_t now = wall_clock_us();
+    std::printf("{\"addr\":\"%08" PRIx32 "\",\"timestamp_us\":%" PRIu64 ",\"age_ms\":%" PRIu64
+                ",\"frames\":%" PRIu64 ",\"state\":%.*s}\n",
+                s.addr, s.timestampUs, now > s.timestampUs ? (now - s.timestampUs) / 1000 : 0,
+                s.frames, (int)raw.size(), raw.data());
+}
+
+static int show(const std::string &name, bool watch, unsigned interval_ms) {
+    StateShmReader reader;
+    std::string error;
+    if (!reader.open(name, &error)) {
+        std::fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    uint64_t seen[kStateShmSlots] = {};
+    do {
+        for (size_t i = 0; i < reader.heaters(); i++) {
+            uint64_t seq = reader.sequence(i);
+            if (seq == seen[i]) continue;
+            StateShmSnapshot snap;
+            if (reader.read(i, &snap)) {
+                print_snapshot(snap);
+            } else if (reader.sequence(i) & 1) {
+                // Left mid-write; tried again on the next poll
+                std::fprintf(stderr, "%s: heater %zu is stuck mid-update\n", name.c_str(), i);
+                continue;
+            }
+            seen[i] = seq;
+        }
+        std::fflush(stdout);
+        if (!watch) break;
+        if (!reader.writerAlive()) {
+            std::fprintf(stderr, "%s: writer exited\n", name.c_str());
+            return 1;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(interval_ms));
+    } while (true);
+
+    if (!watch) {
+        const StateShmHeader &h = reader.header();
+        std::fprintf(stderr, "%zu heater(s), %" PRIu64 " updates, %" PRIu64 " packets received, "
+                     "%" PRIu64 " CRC errors, writer pid %d\n",
+                     reader.heaters(), h.updates.load(), h.rxPackets.load(), h.rxCrcErrors.load(),
+                     (int)h.writerPid.load());
+    }
+    return 0;
+}
+
+// Every field the writer stores is derived from one counter, so a torn copy
+// shows up as a mismatch.
+static void bench_state(uint64_t i, heater_state_t *st) {
+    st->state       = uint8_t(i);
+    st->voltage     = float(i & 0xFFFF);
+    st->ambientTemp = int8_t(i >> 3);
+    st->pumpFreq    = float((i >> 16) & 0xFFFF);
+    st->rssi        = int16_t(i >> 5);
+}
+
+static bool bench_consistent(const StateShmSnapshot &s) {
+    heater_state_t want;
+    bench_state(s.frames, &want);
+    return s.addr == uint32_t(s.frames) && s.timestampUs == s.frames * 3 &&
+           s.state.state == want.state && s.state.voltage == want.voltage &&
+           s.state.ambientTemp == want.ambientTemp && s.state.pumpFreq == want.pumpFreq &&
+           s.state.rssi == want.rssi;
+}
+
+struct BenchResult {
+    uint64_t reads = 0, retries = 0, torn = 0, updates = 0;
+    double   secs  = 0;
+};
+
+static BenchResult bench_phase(StateShmWriter &writer, StateShmReader &reader,
+                               unsigned readers, double seconds, bool busy) {
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> reads{0}, retries{0}, torn{0}, updates{0};
+
+    std::thread w([&] {
+        uint64_t i = 1;
+        heater_state_t st;
+        do {
+            bench_state(i, &st);
+            writer.update(0, uint32_t(i), st, i * 3, i);
+            i++;
+        } while (busy && !stop.load(std::memory_order_relaxed));
+        updates = i - 1;
+    });
+    if (!busy) w.join();
+
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned r = 0; r < readers; r++) {
+        threads.emplace_back([&] {
+            uint64_t n = 0, retried = 0, bad = 0;
+            StateShmSnapshot snap;
+            while (!stop.load(std::memory_order_relaxed)) {
+                for (int k = 0; k < 1024; k++) {
+                    reader.read(0, &snap, &retried);
+                    if (!bench_consistent(snap)) bad++;
+                }
+                n += 1024;
+            }
+            reads += n;
+            retries += retried;
+            torn += bad;
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop = true;
+    for (auto &t : threads) t.join();
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (busy) w.join();
+
+    BenchResult r;
+    r.reads = reads; r.retries = retries; r.torn = torn; r.updates = updates; r.secs = secs;
+    return r;
+}
+
+static int bench(double seconds, unsigned readers) {
+    std::string name = "/diesel_heater_bench_" + std::to_string(::getpid());
+    StateShmWriter writer;
+    StateShmReader reader;
+    std::string error;
+    if (!writer.open(name, &error) || !reader.open(name, &error)) {
+        std::fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    int rc = 0;
+    for (bool busy : { false, true }) {
+        BenchResult r = bench_phase(writer, reader, readers, seconds, busy);
+        double per_reader = r.reads / r.secs / readers;
+        std::printf("{\"writer\":\"%s\",\"readers\":%u,\"reads_per_s\":%.0f,\"ns_per_read\":%.1f,"
+                    "\"retry_rate\":%.4f,\"writer_updates_per_s\":%.0f,\"inconsistent\":%" PRIu64 "}\n",
+                    busy ? "busy" : "idle", readers, per_reader, 1e9 / per_reader,
+                    r.reads ? double(r.retries) / r.reads : 0.0,
+                    busy ? r.updates / r.secs : 0.0, r.torn);
+        if (r.torn) rc = 1;
+    }
+    writer.close();
+    return rc;
+}
+
+int main(int argc, char **argv) {
+    const char *env_name = std::getenv("STATE_SHM_NAME");
+    std::string name = env_name && *env_name ? env_name : "/diesel_heater";
+    bool     watch       = false;
+    unsigned interval_ms = 100;
+    double   bench_s     = 0;
+    unsigned readers     = 1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:wi:b:t:h")) != -1) {
+        switch (opt) {
+            case 'n': name = optarg; break;
+            case 'w': watch = true; break;
+            case 'i': interval_ms = (unsigned)std::strtoul(optarg, nullptr, 10); break;
+            case 'b': bench_s = std::atof(optarg); break;
+            case 't': readers = (unsigned)std::strtoul(optarg, nullptr, 10); break;
+            default:  usage(argv[0]); return 2;
+        }
+    }
+    if (optind != argc || readers == 0 || bench_s < 0) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (bench_s > 0) return bench(bench_s, readers);
+    return show(name, watch, interval_ms);
+}